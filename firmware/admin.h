@@ -14,7 +14,16 @@
 #include <SD.h>
 #include "config.h"
 #include "parser.h"
+#include "storage.h"
 #include "initializer.h"
+#include "postindex.h"
+#include "pagecache.h"
+#include "search.h"
+#include "assets.h"
+#include "logger.h"
+#include "stats.h"
+#include "metrics.h"
+#include "renderer.h"
 
 // ============================================================================
 // AUTHENTICATION
@@ -82,7 +91,68 @@ bool checkAuth() {
 
 void requestAuth() {
   server.sendHeader("WWW-Authenticate", "Basic realm=\"Admin Panel\"");
-  server.send(401, "text/html", "<h1>401 Unauthorized</h1><p>Authentication required.</p>");
+  sendResponse(401, "text/html", "<h1>401 Unauthorized</h1><p>Authentication required.</p>");
+}
+
+// ============================================================================
+// CACHE REFRESH
+// ============================================================================
+
+// Refreshes what depends on the serving mode: /site when it is served
+// prebuilt, otherwise templates and the caches built from posts. Returns
+// true if path was one of those.
+bool refreshPageCachesFor(const String& path) {
+  #if SERVE_PREBUILT_SITE
+  // Posts and templates only reach visitors through a rebuilt /site
+  if (path.startsWith(SITE_DIR "/")) {
+    loadPrebuiltSite();
+    loadGzipIndex();
+    #if ENABLE_STATIC_CACHE
+    clearStaticCache();
+    #endif
+    return true;
+  }
+  #else
+  if (path.startsWith("/templates/")) {
+    loadTemplateCache();
+    clearPageCache();
+    return true;
+  }
+  if (path.startsWith("/posts/")) {
+    String fileName = path.substring(7);
+    updatePostIndex(fileName);
+    invalidatePostPages(fileName);
+    #if ENABLE_SEARCH
+    updateSearchIndex();
+    #endif
+    return true;
+  }
+  #endif
+  return false;
+}
+
+// Brings everything loaded from path up to date after it is written or
+// removed through the admin panel
+void refreshCachesFor(const String& path) {
+  if (refreshPageCachesFor(path)) {
+    return;
+  }
+  
+  if (path.startsWith(STATIC_DIR "/")) {
+    loadGzipIndex();
+    #if ENABLE_STATIC_CACHE
+    clearStaticCache();
+    #endif
+  #if ENABLE_TRAFFIC_STATS
+  } else if (path == STATS_PATH) {
+    // Deleting the checkpoint resets the counts too
+    loadTrafficStats();
+  #endif
+  } else if (path.startsWith(ACCESS_LOG_DIR "/")) {
+    #if ENABLE_TRAFFIC_LOG
+    reloadTrafficLog();
+    #endif
+  }
 }
 
 // ============================================================================
@@ -96,7 +166,7 @@ void handleAdminPanel() {
   }
   
   String html = loadTemplate("admin.html");
-  server.send(200, "text/html", html);
+  sendResponse(200, "text/html", html);
 }
 
 void handleAdminFiles() {
@@ -105,12 +175,16 @@ void handleAdminFiles() {
     return;
   }
   
+  #if ENABLE_TRAFFIC_LOG
+  flushTrafficLog();  // So /logs reflects every request so far
+  #endif
+  
   String dir = server.arg("dir");
   if (dir == "") dir = "/posts";
   
-  File root = SD.open(dir);
+  File root = openFile(dir);
   if (!root || !root.isDirectory()) {
-    server.send(404, "text/html", "<h1>Error: Cannot open directory</h1>");
+    sendResponse(404, "text/html", "<h1>Error: Cannot open directory</h1>");
     return;
   }
   
@@ -173,7 +247,7 @@ void handleAdminFiles() {
   html.replace("{{DIRECTORY}}", dir);
   html.replace("{{FILE_LIST}}", fileListHtml);
   
-  server.send(200, "text/html", html);
+  sendResponse(200, "text/html", html);
 }
 
 void handleAdminEdit() {
@@ -182,111 +256,225 @@ void handleAdminEdit() {
     return;
   }
   
+  #if ENABLE_TRAFFIC_LOG
+  flushTrafficLog();
+  #endif
+  
   String filePath = server.arg("file");
   
-  File file = SD.open(filePath, FILE_READ);
+  File file = openFile(filePath, FILE_READ);
   if (!file) {
-    server.send(404, "text/html", "<h1>File not found</h1>");
+    sendResponse(404, "text/html", "<h1>File not found</h1>");
     return;
   }
   
-  String content = "";
-  while (file.available()) {
-    content += (char)file.read();
-  }
-  file.close();
-  
-  String escapedContent = escapeHtml(content);
-  
   String html = loadTemplate("admin-edit.html");
   html.replace("{{FILE_PATH}}", filePath);
-  html.replace("{{CONTENT}}", escapedContent);
+  html.replace("{{CONTENT_LENGTH}}", String(file.size()));
+  
+  const char* placeholder = "{{CONTENT}}";
+  int content = html.indexOf(placeholder);
+  int rest = (content < 0) ? html.length() : content + strlen(placeholder);
+  if (content < 0) content = html.length();
   
-  String sizeWarning = String(content.length()) + " characters";
-  if (content.length() > 4000) {
-    sizeWarning += " ⚠️ WARNING: Files >4KB may fail to save due to ESP8266 memory limits!";
+  // The file is escaped into the textarea block by block, never held in
+  // RAM, so posts of any size can be edited
+  if (beginChunkedPage(200)) {
+    writeOutput(html.c_str(), content);
+    
+    char block[SD_BLOCK_SIZE];
+    int bytesRead;
+    while ((bytesRead = readFile(file, block, sizeof(block))) > 0) {
+      writeEscaped(block, bytesRead);
+      yield();
+    }
+    
+    writeOutput(html.c_str() + rest, html.length() - rest);
+    endChunkedPage();
+  }
+  file.close();
+}
+
+// ============================================================================
+// FILE WRITES
+// ============================================================================
+
+// A file being saved or uploaded. Data goes to path.tmp and only replaces
+// path once all of it is on the card, so a failed or interrupted write
+// leaves the old file as it was.
+struct AdminWrite {
+  String path;
+  File file;
+  size_t bytesWritten;
+  bool started;  // Set by the upload handler, cleared by the request handler
+  bool failed;
+};
+
+AdminWrite adminWrite;
+
+void beginAdminWrite(const String& path) {
+  adminWrite.path = path;
+  adminWrite.bytesWritten = 0;
+  adminWrite.failed = true;
+  if (path.length() == 0 || path.endsWith("/")) return;
+  
+  // FILE_WRITE appends, so start from an empty file
+  String tempPath = path + ".tmp";
+  SD.remove(tempPath);
+  adminWrite.file = openFile(tempPath, FILE_WRITE);
+  adminWrite.failed = !adminWrite.file;
+}
+
+void writeAdminBlock(const uint8_t* data, size_t length) {
+  if (adminWrite.failed) return;
+  
+  size_t written = writeFile(adminWrite.file, data, length);
+  adminWrite.bytesWritten += written;
+  if (written != length) {
+    Serial.println("ERROR: Write failed: " + adminWrite.path + ".tmp");
+    adminWrite.failed = true;
   }
-  html.replace("{{CONTENT_LENGTH}}", sizeWarning);
+}
+
+// Drops the temporary file; the original is untouched
+void abortAdminWrite() {
+  if (adminWrite.file) adminWrite.file.close();
+  SD.remove(adminWrite.path + ".tmp");
+  adminWrite.failed = true;
+}
+
+// Moves the temporary file over the original. Returns false, with the
+// original untouched, if anything went wrong.
+bool commitAdminWrite() {
+  if (adminWrite.failed) {
+    abortAdminWrite();
+    return false;
+  }
+  adminWrite.file.close();
+  
+  // SD.rename() won't replace an existing file
+  String tempPath = adminWrite.path + ".tmp";
+  SD.remove(adminWrite.path);
+  if (!SD.rename(tempPath, adminWrite.path)) {
+    Serial.println("ERROR: Could not rename " + tempPath);
+    adminWrite.failed = true;
+    return false;
+  }
+  return true;
+}
+
+// Upload handler body shared by save and upload: streams the file part of
+// a multipart form into path in HTTP_UPLOAD_BUFLEN blocks. The core parses
+// the other form fields only after the file, so path must come from the
+// query string.
+void receiveAdminWrite(const String& path) {
+  HTTPUpload& upload = server.upload();
   
-  server.send(200, "text/html", html);
+  if (upload.status == UPLOAD_FILE_START) {
+    if (adminWrite.started) {
+      abortAdminWrite();  // Only one file per request
+    } else if (checkAuth()) {
+      beginAdminWrite(path);
+    } else {
+      adminWrite.failed = true;
+    }
+    adminWrite.started = true;
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    writeAdminBlock(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    if (adminWrite.file) adminWrite.file.close();
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    abortAdminWrite();
+    adminWrite.started = false;
+  }
 }
 
+// ============================================================================
+// SAVE AND UPLOAD HANDLERS
+// ============================================================================
+
+void sendSaveError(const String& filePath, const String& reason) {
+  String html = loadTemplate("admin-save-error.html");
+  html.replace("{{FILE_PATH}}", filePath);
+  html.replace("{{REASON}}", reason);
+  sendResponse(500, "text/html", html);
+}
+
+// The editor sends the text as a file part, streamed to the card by
+// handleAdminSaveData(); a plain form post (no JavaScript) arrives as the
+// content argument and is written from RAM
 void handleAdminSave() {
+  bool streamed = adminWrite.started;
+  adminWrite.started = false;
+  
   if (!checkAuth()) {
-    requestAuth();
+    requestAuth();  // Nothing was written: the upload handler checked too
     return;
   }
   
   String filePath = server.arg("file");
-  String content = server.arg("content");
+  if (!streamed) {
+    String content = server.arg("content");
+    beginAdminWrite(filePath);
+    writeAdminBlock((const uint8_t*)content.c_str(), content.length());
+  }
   
-  Serial.println("=== Admin Save Debug ===");
-  Serial.println("File: " + filePath);
-  Serial.println("Content length received: " + String(content.length()));
+  Serial.println("Saving " + filePath + ": " + String(adminWrite.bytesWritten) + " bytes");
   
-  if (content.length() == 0) {
-    String html = loadTemplate("admin-save-error.html");
-    html.replace("{{FILE_PATH}}", filePath);
-    server.send(500, "text/html", html);
+  // An empty post is almost always a failed form submission
+  if (adminWrite.bytesWritten == 0) {
+    abortAdminWrite();
+    sendSaveError(filePath, "No content was received.");
     return;
   }
-  
-  if (SD.exists(filePath)) {
-    if (!SD.remove(filePath)) {
-      server.send(500, "text/html", "<h1>Error: Cannot delete old file</h1>");
-      return;
-    }
-  }
-  
-  File file = SD.open(filePath, FILE_WRITE);
-  if (!file) {
-    server.send(500, "text/html", "<h1>Error: Cannot open file for writing</h1>");
+  if (!commitAdminWrite()) {
+    sendSaveError(filePath, "The file could not be written to the SD card.");
     return;
   }
   
-  size_t bytesWritten = file.print(content);
-  file.close();
+  refreshCachesFor(filePath);
   
   String html = loadTemplate("admin-success.html");
   html.replace("{{REDIRECT_URL}}", "/admin");
   html.replace("{{ICON}}", "✅");
   html.replace("{{MESSAGE}}", "File Saved Successfully!");
-  html.replace("{{DETAILS}}", "<p>" + filePath + "</p><p>" + String(bytesWritten) + " bytes written</p>");
+  html.replace("{{DETAILS}}", "<p>" + filePath + "</p><p>" + String(adminWrite.bytesWritten) + " bytes written</p>");
   
-  server.send(200, "text/html", html);
+  sendResponse(200, "text/html", html);
+}
+
+void handleAdminSaveData() {
+  receiveAdminWrite(server.arg("file"));
 }
 
 void handleAdminUpload() {
+  bool streamed = adminWrite.started;
+  adminWrite.started = false;
+  
   if (!checkAuth()) {
-    requestAuth();
+    requestAuth();  // Nothing was written: the upload handler checked too
     return;
   }
   
-  HTTPUpload& upload = server.upload();
-  static File uploadFile;
-  
-  if (upload.status == UPLOAD_FILE_START) {
-    String path = server.arg("path");
-    uploadFile = SD.open(path, FILE_WRITE);
-  } else if (upload.status == UPLOAD_FILE_WRITE) {
-    if (uploadFile) {
-      uploadFile.write(upload.buf, upload.currentSize);
-    }
-  } else if (upload.status == UPLOAD_FILE_END) {
-    if (uploadFile) {
-      uploadFile.close();
-      
-      String html = loadTemplate("admin-success.html");
-      html.replace("{{REDIRECT_URL}}", "/admin");
-      html.replace("{{ICON}}", "✅");
-      html.replace("{{MESSAGE}}", "File Uploaded Successfully!");
-      html.replace("{{DETAILS}}", "<p>" + String(upload.totalSize) + " bytes</p>");
-      
-      server.send(200, "text/html", html);
-    } else {
-      server.send(500, "text/html", "<h1>Upload Failed</h1>");
-    }
+  String path = server.arg("path");
+  if (!streamed || !commitAdminWrite()) {
+    sendResponse(500, "text/html", "<h1>Upload Failed</h1>");
+    return;
   }
+  
+  refreshCachesFor(path);
+  
+  String html = loadTemplate("admin-success.html");
+  html.replace("{{REDIRECT_URL}}", "/admin");
+  html.replace("{{ICON}}", "✅");
+  html.replace("{{MESSAGE}}", "File Uploaded Successfully!");
+  html.replace("{{DETAILS}}", "<p>" + path + "</p><p>" + String(adminWrite.bytesWritten) + " bytes</p>");
+  
+  sendResponse(200, "text/html", html);
+}
+
+void handleAdminUploadData() {
+  receiveAdminWrite(server.arg("path"));
 }
 
 void handleAdminDelete() {
@@ -295,18 +483,24 @@ void handleAdminDelete() {
     return;
   }
   
+  #if ENABLE_TRAFFIC_LOG
+  flushTrafficLog();
+  #endif
+  
   String filePath = server.arg("file");
   
   if (SD.remove(filePath)) {
+    refreshCachesFor(filePath);
+    
     String html = loadTemplate("admin-success.html");
     html.replace("{{REDIRECT_URL}}", "/admin");
     html.replace("{{ICON}}", "✅");
     html.replace("{{MESSAGE}}", "File Deleted Successfully!");
     html.replace("{{DETAILS}}", "<p>" + filePath + "</p>");
     
-    server.send(200, "text/html", html);
+    sendResponse(200, "text/html", html);
   } else {
-    server.send(500, "text/html", "<h1>Delete Failed</h1>");
+    sendResponse(500, "text/html", "<h1>Delete Failed</h1>");
   }
 }
 
@@ -316,6 +510,9 @@ void handleAdminReload() {
     return;
   }
   
+  #if ENABLE_TRAFFIC_LOG
+  flushTrafficLog();
+  #endif
   reloadConfigurations();
   
   String html = loadTemplate("admin-success.html");
@@ -324,73 +521,299 @@ void handleAdminReload() {
   html.replace("{{MESSAGE}}", "Configuration Reloaded!");
   html.replace("{{DETAILS}}", "<p>Posts: " + String(postMappingsCount) + "</p><p>Redirects: " + String(redirectionsCount) + "</p>");
   
-  server.send(200, "text/html", html);
+  sendResponse(200, "text/html", html);
 }
 
+// ============================================================================
+// TRAFFIC PAGES
+// ============================================================================
+
+// Opens the page shared by the log viewer and the stats page
+void writeTrafficPageHead(const char* title, const char* heading) {
+  writeOutput("<!DOCTYPE html><html><head><meta charset='UTF-8'>");
+  writeOutput("<meta name='viewport' content='width=device-width,initial-scale=1.0'>");
+  writeOutput("<title>" + String(title) + "</title>");
+  writeOutput("<style>body{font-family:monospace;margin:0;padding:20px;background:#1e1e1e;color:#d4d4d4}");
+  writeOutput(".header{background:#333;color:white;padding:20px;margin:-20px -20px 20px}");
+  writeOutput(".container{max-width:1200px;margin:0 auto;background:#2d2d2d;padding:30px;border-radius:8px}");
+  writeOutput(".log-entry{padding:8px;border-bottom:1px solid #444;font-size:14px;line-height:1.6}");
+  writeOutput(".log-entry:hover{background:#333}");
+  writeOutput("table{border-collapse:collapse;width:100%;margin-bottom:30px}");
+  writeOutput("td,th{padding:6px 8px;border-bottom:1px solid #444;text-align:left}td.n{text-align:right;width:8em}");
+  writeOutput(".bar{background:#0066cc;height:12px}");
+  writeOutput(".btn{background:#0066cc;color:white;padding:10px 20px;text-decoration:none;border-radius:4px;display:inline-block;margin:10px 5px 0 0}");
+  writeOutput(".info{color:#888;margin-bottom:20px}</style></head><body>");
+  writeOutput("<div class='header'><h1>" + String(heading) + "</h1></div>");
+  writeOutput("<div class='container'>");
+  writeOutput("<a href='/admin' class='btn'>← Back to Admin</a>");
+}
+
+// One page of the log as .log-entry divs, escaped on the way out. Returns
+// the number of entries written.
+int writeLogLines(File& logFile, size_t start, size_t end) {
+  uint8_t block[SD_BLOCK_SIZE];
+  bool lineOpen = false;
+  int lines = 0;
+  
+  logFile.seek(start);
+  for (size_t position = start; position < end;) {
+    int n = readFile(logFile, block, min(end - position, sizeof(block)));
+    if (n <= 0) break;
+    position += n;
+    
+    for (int i = 0; i < n; i++) {
+      char c = block[i];
+      if (!lineOpen) {
+        writeOutput("<div class='log-entry'>");
+        lineOpen = true;
+        lines++;
+      }
+      if (c == '\n') {
+        writeOutput("</div>");
+        lineOpen = false;
+      } else if (c != '\r') {
+        writeEscaped(&c, 1);
+      }
+    }
+  }
+  if (lineOpen) writeOutput("</div>");
+  return lines;
+}
+
+#if LOG_FORMAT_BINARY
+void writeLogRecords(File& logFile, size_t start, size_t end) {
+  LogStringReader strings(ACCESS_LOG_STR_PATH);
+  AccessLogRecord record;
+  char entry[LOG_ENTRY_SIZE];
+  
+  for (size_t position = start; position < end; position += sizeof(record)) {
+    logFile.seek(position);
+    if (readFile(logFile, &record, sizeof(record)) != sizeof(record)) break;
+    
+    size_t length = formatLogRecord(record, strings, entry, sizeof(entry));
+    writeOutput("<div class='log-entry'>");
+    writeEscaped(entry, length - 1);  // Without the newline
+    writeOutput("</div>");
+  }
+}
+#endif
+
+// Shows LOG_PAGE_LINES entries ending at byte offset ?before= (default: the
+// end of the log). The page is streamed, and only the entries shown are read.
+// Text entries are numbered back from the newest: ?skip= carries the count
+// of entries after the page, so no view has to count from the start.
 void handleAdminLogs() {
   if (!checkAuth()) {
     requestAuth();
     return;
   }
   
-  File logFile = SD.open("/logs/access.log", FILE_READ);
+  #if ENABLE_TRAFFIC_LOG
+  flushTrafficLog();
+  #endif
+  
+  #if LOG_FORMAT_BINARY
+  File logFile = openFile(ACCESS_LOG_BIN_PATH, FILE_READ);
+  #else
+  File logFile = openFile(ACCESS_LOG_PATH, FILE_READ);
+  #endif
   
-  String html = "<!DOCTYPE html><html><head><meta charset='UTF-8'>";
-  html += "<meta name='viewport' content='width=device-width,initial-scale=1.0'>";
-  html += "<title>Access Logs</title>";
-  html += "<style>body{font-family:monospace;margin:0;padding:20px;background:#1e1e1e;color:#d4d4d4}";
-  html += ".header{background:#333;color:white;padding:20px;margin:-20px -20px 20px}";
-  html += ".container{max-width:1200px;margin:0 auto;background:#2d2d2d;padding:30px;border-radius:8px}";
-  html += ".log-entry{padding:8px;border-bottom:1px solid #444;font-size:14px;line-height:1.6}";
-  html += ".log-entry:hover{background:#333}";
-  html += ".btn{background:#0066cc;color:white;padding:10px 20px;text-decoration:none;border-radius:4px;display:inline-block;margin:10px 5px 0 0}";
-  html += ".info{color:#888;margin-bottom:20px}</style></head><body>";
-  html += "<div class='header'><h1>📊 Access Logs</h1></div>";
-  html += "<div class='container'>";
-  html += "<a href='/admin' class='btn'>← Back to Admin</a>";
-  html += "<a href='/admin/files?dir=/logs' class='btn'>📁 Manage Logs</a>";
+  beginChunkedPage(200);
+  writeTrafficPageHead("Access Logs", "📊 Access Logs");
+  writeOutput("<a href='/admin/files?dir=/logs' class='btn'>📁 Manage Logs</a>");
   
   if (logFile) {
     size_t fileSize = logFile.size();
-    int lineCount = 0;
-    
-    while (logFile.available()) {
-      logFile.readStringUntil('\n');
-      lineCount++;
+    size_t end = fileSize;
+    if (server.hasArg("before")) {
+      end = min((size_t)server.arg("before").toInt(), fileSize);
     }
-    logFile.close();
     
-    html += "<div class='info'><br>Log file size: " + String(fileSize) + " bytes | ";
-    html += "Total requests: " + String(lineCount) + "</div>";
+    #if LOG_FORMAT_BINARY
+    // Fixed-size records: a page is found with arithmetic alone
+    const size_t recordSize = sizeof(AccessLogRecord);
+    end -= end % recordSize;
+    size_t start = (end > LOG_PAGE_LINES * recordSize) ? end - LOG_PAGE_LINES * recordSize : 0;
+    size_t newer = min(end + LOG_PAGE_LINES * recordSize, fileSize);
+    uint32_t totalEntries = fileSize / recordSize;
     
-    logFile = SD.open("/logs/access.log", FILE_READ);
-    html += "<div style='max-height:600px;overflow-y:auto'>";
+    writeOutput("<div class='info'><br>Log file size: " + String(fileSize) + " bytes | ");
+    writeOutput("Total requests: " + String(totalEntries) + "</div>");
+    #else
+    size_t start = findLinesBefore(logFile, end, LOG_PAGE_LINES);
+    size_t newer = findLinesAfter(logFile, end, LOG_PAGE_LINES);
+    long skip = !server.hasArg("before") ? 0 : server.hasArg("skip") ? server.arg("skip").toInt() : -1;
     
-    int displayCount = 0;
-    int skipLines = (lineCount > 100) ? lineCount - 100 : 0;
-    int currentLine = 0;
+    writeOutput("<div class='info'><br>Log file size: " + String(fileSize) + " bytes</div>");
+    #endif
     
-    while (logFile.available()) {
-      String line = logFile.readStringUntil('\n');
-      if (currentLine >= skipLines) {
-        html += "<div class='log-entry'>" + line + "</div>";
-        displayCount++;
-      }
-      currentLine++;
-    }
-    html += "</div>";
+    writeOutput("<div style='max-height:600px;overflow-y:auto'>");
+    #if LOG_FORMAT_BINARY
+    writeLogRecords(logFile, start, end);
+    #else
+    int shown = writeLogLines(logFile, start, end);
+    #endif
+    writeOutput("</div>");
     logFile.close();
     
-    if (skipLines > 0) {
-      html += "<div class='info'><br>Showing last " + String(displayCount) + " entries (of " + String(lineCount) + " total)</div>";
+    String olderLink = "/admin/logs?before=" + String(start);
+    String newerLink = (newer < fileSize) ? "/admin/logs?before=" + String(newer) : "/admin/logs";
+    #if LOG_FORMAT_BINARY
+    if (end > start) {
+      writeOutput("<div class='info'><br>Showing entries " + String(start / recordSize + 1) + "–" + String(end / recordSize));
+      writeOutput(" (of " + String(totalEntries) + " total)</div>");
+    }
+    #else
+    if (skip >= 0) {
+      olderLink += "&skip=" + String(skip + shown);
+      if (newer < fileSize && skip >= LOG_PAGE_LINES) newerLink += "&skip=" + String(skip - LOG_PAGE_LINES);
+    }
+    if (end > start && skip >= 0) {
+      writeOutput("<div class='info'><br>Showing entries " + String(skip + 1) + "–" + String(skip + shown));
+      writeOutput(", counted back from the newest</div>");
+    } else if (end > start) {
+      writeOutput("<div class='info'><br>Showing " + String(shown) + " entries</div>");
+    }
+    #endif
+    
+    if (end <= start) {
+      writeOutput("<div class='info'><br>No entries before this point</div>");
+    }
+    if (start > 0) {
+      writeOutput("<a href='" + olderLink + "' class='btn'>← Older</a>");
+    }
+    if (end < fileSize) {
+      writeOutput("<a href='" + newerLink + "' class='btn'>Newer →</a>");
+      writeOutput("<a href='/admin/logs' class='btn'>Newest ⇥</a>");
     }
   } else {
-    html += "<p style='color:#888;margin-top:30px'>No log file found. Logs will appear here once traffic starts.</p>";
+    writeOutput("<p style='color:#888;margin-top:30px'>No log file found. Logs will appear here once traffic starts.</p>");
+  }
+  
+  writeOutput("</div></body></html>");
+  endChunkedPage();
+}
+
+#if ENABLE_TRAFFIC_STATS
+// One table row: an escaped label and a count
+void writeStatsRow(const char* label, uint32_t count, const String& detail = "") {
+  writeOutput("<tr><td>");
+  writeEscaped(label, strlen(label));
+  writeOutput("</td><td class='n'>" + String(count) + detail + "</td></tr>");
+}
+
+void writeTopK(const char* heading, const TopKEntry* entries) {
+  writeOutput("<h2>" + String(heading) + "</h2><table>");
+  
+  // Most counted first; K is small, so a selection pass per row will do
+  bool shown[STATS_TOP_K] = {};
+  for (int row = 0; row < STATS_TOP_K; row++) {
+    int best = -1;
+    for (int i = 0; i < STATS_TOP_K; i++) {
+      if (!shown[i] && entries[i].count > 0 && (best < 0 || entries[i].count > entries[best].count)) {
+        best = i;
+      }
+    }
+    if (best < 0) break;
+    shown[best] = true;
+    
+    // Counts that may include evicted keys are upper bounds
+    const TopKEntry& entry = entries[best];
+    writeStatsRow(entry.label, entry.count, entry.error > 0 ? " (±" + String(entry.error) + ")" : "");
+  }
+  writeOutput("</table>");
+}
+
+// Shows the running totals kept by stats.h; nothing is read from the card
+void handleAdminStats() {
+  if (!checkAuth()) {
+    requestAuth();
+    return;
   }
   
-  html += "</div></body></html>";
-  server.send(200, "text/html", html);
+  const TrafficStats& stats = trafficStats;
+  matchRouteHits();
+  
+  beginChunkedPage(200);
+  writeTrafficPageHead("Traffic Stats", "📈 Traffic Stats");
+  writeOutput("<a href='/admin/logs' class='btn'>📊 Access Logs</a>");
+  
+  writeOutput("<div class='info'><br>Total requests: " + String(stats.totalRequests));
+  if (stats.since > 0) {
+    time_t since = stats.since;
+    struct tm timeinfo;
+    char date[32];
+    localtime_r(&since, &timeinfo);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M", &timeinfo);
+    writeOutput(" since " + String(date));
+  }
+  writeOutput("</div>");
+  
+  // Requests per hour, oldest first, as bars scaled to the busiest hour.
+  // Nothing is bucketed until the clock has been set by NTP.
+  writeOutput("<h2>Last 24 hours</h2><table>");
+  uint32_t busiest = 1;
+  for (int i = 0; i < 24; i++) {
+    busiest = max(busiest, stats.hourly[i]);
+  }
+  for (int i = (stats.currentHour > 0) ? 23 : -1; i >= 0; i--) {
+    uint32_t hour = stats.currentHour - i;
+    uint32_t count = stats.hourly[hour % 24];
+    time_t hourStart = (time_t)hour * 3600;
+    struct tm timeinfo;
+    char label[8];
+    localtime_r(&hourStart, &timeinfo);
+    strftime(label, sizeof(label), "%H:00", &timeinfo);
+    writeOutput("<tr><td style='width:4em'>" + String(label) + "</td><td class='n'>" + String(count) + "</td>");
+    writeOutput("<td><div class='bar' style='width:" + String(count * 100 / busiest) + "%'></div></td></tr>");
+  }
+  writeOutput("</table>");
+  
+  writeOutput("<h2>Routes</h2><table>");
+  static const char* const builtinNames[BUILTIN_ROUTE_COUNT] = {
+    "/ and /page", "/archive", "Static files", "Redirects and unknown paths"
+  };
+  for (int i = 0; i < BUILTIN_ROUTE_COUNT; i++) {
+    writeStatsRow(builtinNames[i], stats.builtinHits[i]);
+  }
+  for (int i = 0; i < routeHitsCount; i++) {
+    if (routeHits[i] > 0) {
+      writeStatsRow(postMappings[i].urlPath(), routeHits[i]);
+    }
+  }
+  writeOutput("</table>");
+  
+  writeOutput("<h2>Status codes</h2><table>");
+  for (int i = 0; i < STATS_STATUS_SLOTS && stats.statuses[i].status != 0; i++) {
+    writeStatsRow(String(stats.statuses[i].status).c_str(), stats.statuses[i].count);
+  }
+  if (stats.otherStatuses > 0) {
+    writeStatsRow("Other", stats.otherStatuses);
+  }
+  writeOutput("</table>");
+  
+  writeTopK("Top missing paths", stats.missingPaths);
+  writeTopK("Top user agents", stats.userAgents);
+  
+  writeOutput("</div></body></html>");
+  endChunkedPage();
+}
+#endif // ENABLE_TRAFFIC_STATS
+
+#if ENABLE_METRICS
+// Prometheus text format, for scraping with basic_auth credentials
+void handleAdminMetrics() {
+  if (!checkAuth()) {
+    requestAuth();
+    return;
+  }
+  
+  if (beginChunkedPage(200, "text/plain; version=0.0.4")) {
+    writeMetrics();
+    endChunkedPage();
+  }
 }
+#endif // ENABLE_METRICS
 
 #endif // ENABLE_ADMIN_PANEL
 
@@ -0,0 +1,405 @@
+/*
+ * assets.h - Static Asset Serving
+ *
+ * Streams files from /static, substituting a precompressed foo.css.gz
+ * sidecar when the client accepts gzip. Sidecars are indexed once at boot,
+ * so a request never pays for a failed SD.open looking for one. Small files
+ * that are requested again and again are kept in RAM. Pages pre-rendered by
+ * tools/build_site.py are served the same way from /site.
+ */
+
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include <SD.h>
+#include <algorithm>
+#include "config.h"
+#include "parser.h"
+#include "storage.h"
+#include "httpcache.h"
+#include "logger.h"
+#include "renderer.h"
+
+#define STATIC_DIR "/static"
+#define SITE_DIR "/site"
+#define SITE_MANIFEST_PATH SITE_DIR "/manifest.txt"
+#define GZIP_SUFFIX ".gz"
+
+// Sorted hashes of the asset paths that have a current .gz sidecar
+uint32_t* gzipSidecars = nullptr;
+int gzipSidecarCount = 0;
+
+// ============================================================================
+// SIDECAR INDEX
+// ============================================================================
+
+// Adds every foo.gz under dirPath that is at least as new as foo itself
+void indexGzipSidecars(const String& dirPath, int& capacity) {
+  File dir = openFile(dirPath);
+  if (!dir || !dir.isDirectory()) {
+    return;
+  }
+  
+  while (true) {
+    File entry = dir.openNextFile();
+    if (!entry) break;
+    
+    String name = String(entry.name());
+    int lastSlash = name.lastIndexOf('/');
+    if (lastSlash != -1) {
+      name = name.substring(lastSlash + 1);
+    }
+    String path = dirPath + "/" + name;
+    bool isDirectory = entry.isDirectory();
+    time_t lastWrite = entry.getLastWrite();
+    entry.close();
+    
+    if (isDirectory) {
+      indexGzipSidecars(path, capacity);
+      continue;
+    }
+    if (!path.endsWith(GZIP_SUFFIX)) {
+      continue;
+    }
+    
+    // A sidecar older than its source was left behind by an edit
+    String assetPath = path.substring(0, path.length() - strlen(GZIP_SUFFIX));
+    if (getFileLastWrite(assetPath) > lastWrite) {
+      Serial.println("Ignoring stale " + path);
+      continue;
+    }
+    
+    if (gzipSidecarCount == capacity) {
+      capacity = (capacity > 0) ? capacity * 2 : 16;
+      uint32_t* grown = new uint32_t[capacity];
+      if (gzipSidecarCount > 0) {
+        memcpy(grown, gzipSidecars, gzipSidecarCount * sizeof(uint32_t));
+      }
+      delete[] gzipSidecars;
+      gzipSidecars = grown;
+    }
+    gzipSidecars[gzipSidecarCount++] = hashString(assetPath.c_str());
+    yield();
+  }
+  dir.close();
+}
+
+// Called at boot, on reload and when a file under /static (or /site) changes
+void loadGzipIndex() {
+  delete[] gzipSidecars;
+  gzipSidecars = nullptr;
+  gzipSidecarCount = 0;
+  
+  int capacity = 0;
+  indexGzipSidecars(STATIC_DIR, capacity);
+  #if SERVE_PREBUILT_SITE
+  indexGzipSidecars(SITE_DIR, capacity);
+  #endif
+  std::sort(gzipSidecars, gzipSidecars + gzipSidecarCount);
+  
+  Serial.printf("Found %d gzip sidecars\n", gzipSidecarCount);
+}
+
+bool hasGzipSidecar(const String& path) {
+  return std::binary_search(gzipSidecars, gzipSidecars + gzipSidecarCount, hashString(path.c_str()));
+}
+
+// ============================================================================
+// PREBUILT SITE
+// ============================================================================
+
+#if SERVE_PREBUILT_SITE
+
+// Sorted hashes of the URLs listed in the site manifest. Each page is
+// stored as /site/<hash>.htm, so the hash is all a request needs.
+uint32_t* prebuiltPages = nullptr;
+int prebuiltPageCount = 0;
+
+// Called at boot, on reload and when a file under /site changes
+void loadPrebuiltSite() {
+  delete[] prebuiltPages;
+  prebuiltPages = nullptr;
+  prebuiltPageCount = 0;
+  
+  File manifest = openFile(SITE_MANIFEST_PATH, FILE_READ);
+  if (!manifest) {
+    Serial.println("ERROR: No " SITE_MANIFEST_PATH ", run tools/build_site.py");
+    return;
+  }
+  
+  // One page per line; the file size bounds the count from above
+  int capacity = max(1, (int)(manifest.size() / 16));
+  prebuiltPages = new uint32_t[capacity];
+  
+  BufferedReader reader(manifest);
+  char line[256];
+  while (prebuiltPageCount < capacity && reader.readLine(line, sizeof(line))) {
+    char* end = strchr(line, '|');
+    if (line[0] != '/' || !end) continue;
+    *end = '\0';
+    prebuiltPages[prebuiltPageCount++] = hashString(line);
+  }
+  manifest.close();
+  std::sort(prebuiltPages, prebuiltPages + prebuiltPageCount);
+  
+  Serial.printf("Prebuilt site: %d pages\n", prebuiltPageCount);
+}
+
+bool hasPrebuiltPage(const String& url) {
+  return std::binary_search(prebuiltPages, prebuiltPages + prebuiltPageCount, hashString(url.c_str()));
+}
+
+// Named as tools/build_site.py names it
+String prebuiltPagePath(const String& url) {
+  char path[32];
+  snprintf(path, sizeof(path), SITE_DIR "/%08x.htm", (unsigned)hashString(url.c_str()));
+  return path;
+}
+
+#endif // SERVE_PREBUILT_SITE
+
+// ============================================================================
+// CONTENT NEGOTIATION
+// ============================================================================
+
+// True if Accept-Encoding lists gzip (or *) without q=0
+bool clientAcceptsGzip() {
+  String header = server.header("Accept-Encoding");
+  header.toLowerCase();
+  
+  bool accepted = false;
+  int start = 0;
+  while (start < (int)header.length()) {
+    int end = header.indexOf(',', start);
+    if (end < 0) end = header.length();
+    
+    String coding = header.substring(start, end);
+    float quality = 1.0;
+    int params = coding.indexOf(';');
+    if (params >= 0) {
+      int q = coding.indexOf("q=", params);
+      if (q >= 0) quality = coding.substring(q + 2).toFloat();
+      coding = coding.substring(0, params);
+    }
+    coding.trim();
+    
+    // An explicit gzip entry overrides the wildcard
+    if (coding == "gzip") return quality > 0;
+    if (coding == "*") accepted = quality > 0;
+    
+    start = end + 1;
+  }
+  return accepted;
+}
+
+// ============================================================================
+// RAM CACHE
+// ============================================================================
+
+#if ENABLE_STATIC_CACHE
+
+// A whole static file held in RAM, in the encoding it is sent in
+struct CachedAsset {
+  uint32_t key;        // assetCacheKey() of the path and encoding
+  uint8_t* data;       // nullptr for an unused entry
+  size_t size;
+  bool gzip;           // data is the .gz sidecar
+  String contentType;
+  String etag;         // As fileETag() gave it for the file
+  time_t lastModified;
+  uint32_t lastUsed;   // staticCacheClock at the last hit
+};
+
+CachedAsset staticCache[STATIC_CACHE_ENTRIES];
+size_t staticCacheBytes = 0;
+uint32_t staticCacheClock = 0;
+
+// Keys of recent misses. A file is cached on its second request, so a
+// one-off fetch never displaces a file that every page view uses.
+uint32_t staticCacheCandidates[STATIC_CACHE_ENTRIES];
+int staticCacheNextCandidate = 0;
+
+uint32_t assetCacheKey(const String& path, bool gzip) {
+  return hashCombine(hashString(path.c_str()), gzip);
+}
+
+CachedAsset* findCachedAsset(uint32_t key) {
+  for (CachedAsset& asset : staticCache) {
+    if (asset.data && asset.key == key) return &asset;
+  }
+  return nullptr;
+}
+
+void dropCachedAsset(CachedAsset& asset) {
+  delete[] asset.data;
+  asset.data = nullptr;
+  staticCacheBytes -= asset.size;
+  asset.contentType = String();
+  asset.etag = String();
+}
+
+// Returns nullptr when the cache is empty
+CachedAsset* leastRecentlyUsedAsset() {
+  CachedAsset* oldest = nullptr;
+  for (CachedAsset& asset : staticCache) {
+    if (asset.data && (!oldest || asset.lastUsed < oldest->lastUsed)) {
+      oldest = &asset;
+    }
+  }
+  return oldest;
+}
+
+// Called on reload and whenever a file under /static changes
+void clearStaticCache() {
+  for (CachedAsset& asset : staticCache) {
+    if (asset.data) dropCachedAsset(asset);
+  }
+}
+
+// Called from loop(): gives RAM back once free heap falls below the watermark
+void trimStaticCache() {
+  while (ESP.getFreeHeap() < STATIC_CACHE_MIN_FREE_HEAP) {
+    CachedAsset* oldest = leastRecentlyUsedAsset();
+    if (!oldest) break;
+    dropCachedAsset(*oldest);
+  }
+}
+
+// True if key missed recently; otherwise remembers it and returns false
+bool admitToStaticCache(uint32_t key) {
+  for (uint32_t candidate : staticCacheCandidates) {
+    if (candidate == key) return true;
+  }
+  staticCacheCandidates[staticCacheNextCandidate] = key;
+  staticCacheNextCandidate = (staticCacheNextCandidate + 1) % STATIC_CACHE_ENTRIES;
+  return false;
+}
+
+// Reads file into the cache, evicting least recently used files to stay in
+// budget. Returns nullptr, having read nothing, if it isn't cached.
+CachedAsset* cacheAsset(uint32_t key, File& file, const String& contentType, bool gzip,
+                        const String& etag, time_t lastModified) {
+  size_t size = file.size();
+  if (size == 0 || size > STATIC_CACHE_MAX_FILE_SIZE || size > STATIC_CACHE_BYTES) return nullptr;
+  if (ESP.getFreeHeap() < STATIC_CACHE_MIN_FREE_HEAP + size || !admitToStaticCache(key)) return nullptr;
+  
+  CachedAsset* slot = nullptr;
+  while (true) {
+    for (CachedAsset& asset : staticCache) {
+      if (!asset.data) slot = &asset;
+    }
+    if (slot && staticCacheBytes + size <= STATIC_CACHE_BYTES) break;
+    dropCachedAsset(*leastRecentlyUsedAsset());
+  }
+  
+  uint8_t* data = new uint8_t[size];
+  if (readFile(file, data, size) != (int)size) {
+    delete[] data;
+    file.seek(0);
+    return nullptr;
+  }
+  
+  slot->key = key;
+  slot->data = data;
+  slot->size = size;
+  slot->gzip = gzip;
+  slot->contentType = contentType;
+  slot->etag = etag;
+  slot->lastModified = lastModified;
+  slot->lastUsed = ++staticCacheClock;
+  staticCacheBytes += size;
+  return slot;
+}
+
+// The same response streamFile() gives for the file
+void sendCachedAsset(const CachedAsset& asset) {
+  if (asset.gzip) {
+    server.sendHeader("Content-Encoding", "gzip");
+  }
+  sendBufferResponse(200, asset.contentType.c_str(), (const char*)asset.data, asset.size);
+}
+
+#endif // ENABLE_STATIC_CACHE
+
+// ============================================================================
+// ASSET STREAMING
+// ============================================================================
+
+// Streams path, or path.gz to clients that accept it, with validators and
+// the given Cache-Control. Returns false, having sent nothing, if there is
+// no such file. A cached file is sent without touching the SD card.
+bool streamAsset(const String& path, const String& contentType, const char* cacheControl = nullptr) {
+  bool hasSidecar = hasGzipSidecar(path);
+  bool gzip = hasSidecar && clientAcceptsGzip();
+  
+  String etag;
+  time_t lastModified = 0;
+  File file;
+  
+  #if ENABLE_STATIC_CACHE
+  CachedAsset* cached = findCachedAsset(assetCacheKey(path, gzip));
+  if (cached) {
+    cached->lastUsed = ++staticCacheClock;
+    etag = cached->etag;
+    lastModified = cached->lastModified;
+  } else
+  #endif
+  {
+    if (gzip) {
+      file = openFile(path + GZIP_SUFFIX, FILE_READ);
+    }
+    if (!file) {
+      gzip = false;
+      file = openFile(path, FILE_READ);
+    }
+    if (!file) {
+      return false;
+    }
+    
+    size_t fileSize = file.size();
+    if (fileSize > 200000) {
+      Serial.println("WARNING: Serving large file (" + String(fileSize) + " bytes): " + path);
+    }
+    
+    // The two encodings differ in size and date, so they get different ETags
+    etag = fileETag(file);
+    lastModified = file.getLastWrite();
+  }
+  
+  if (cacheControl) {
+    server.sendHeader("Cache-Control", cacheControl);
+  }
+  if (hasSidecar) {
+    server.sendHeader("Vary", "Accept-Encoding");
+  }
+  
+  if (sendValidators(etag, lastModified)) {
+    file.close();
+    return true;
+  }
+  
+  #if ENABLE_TRAFFIC_LOG
+  logTraffic(200);
+  #endif
+  
+  #if ENABLE_STATIC_CACHE
+  if (!cached && server.method() != HTTP_HEAD) {
+    cached = cacheAsset(assetCacheKey(path, gzip), file, contentType, gzip, etag, lastModified);
+  }
+  if (cached) {
+    sendCachedAsset(*cached);
+    file.close();
+    return true;
+  }
+  #endif
+  
+  // streamFile adds Content-Encoding: gzip itself for a .gz file sent
+  // under another content type
+  streamFileResponse(file, contentType);
+  file.close();
+  return true;
+}
+
+#endif // ASSETS_H
@@ -20,6 +20,9 @@ const char* password = "my_network_password";
 // Admin panel
 #define ENABLE_ADMIN_PANEL true
 const char* adminPassword = "admin123";  // ⚠️ Change this!
+#define ENABLE_DEPLOY true  // Bulk tar / tar.gz updates at /admin/deploy
+const int DEPLOY_GZIP_WINDOW = 8192;  // Power of two; tools/deploy.py compresses to fit
+const uint32_t DEPLOY_MIN_FREE_HEAP = 12288;  // A .tar.gz is refused below this plus the window
 
 // Hardware pins
 const int SD_CS_PIN = D8;
@@ -28,6 +31,26 @@ const int WIFI_LED_PIN = LED_BUILTIN;
 // Traffic logging
 #define ENABLE_TRAFFIC_LOG true  // Set to false to disable logging
 const int MAX_LOG_SIZE = 500000;  // 500KB max log size before rotation
+const int LOG_GENERATIONS = 3;    // Rotated logs kept as access.1 (newest) to access.3
+const int LOG_BUFFER_SIZE = 2048;  // Entries held in RAM between SD writes
+const int LOG_ENTRY_SIZE = 256;    // Longer entries are truncated
+const unsigned long LOG_FLUSH_IDLE_MS = 2000;  // Write a partial batch after this much quiet
+#define LOG_TO_SERIAL true  // Echo each entry to Serial (about 1ms per line at 115200 baud)
+#define LOG_FORMAT_BINARY false  // 16-byte records in access.bin instead of text lines
+const int LOG_STRING_TABLE_SIZE = 512;   // Distinct URIs / user agents per binary log file
+const int LOG_STRING_BUFFER_SIZE = 512;  // New URIs / user agents held in RAM between SD writes
+const int LOG_PAGE_LINES = 100;  // Entries per page in /admin/logs
+
+// Traffic statistics (see stats.h; counted as requests are logged)
+#define ENABLE_TRAFFIC_STATS true
+const int STATS_TOP_K = 10;          // Missing paths / user agents tracked
+const int STATS_LABEL_SIZE = 48;     // Longer paths and user agents are truncated
+const int STATS_STATUS_SLOTS = 8;    // Distinct status codes counted
+const unsigned long STATS_CHECKPOINT_MS = 600000;  // Save to SD at most every 10 minutes
+
+// Handler timing and I/O counters at /admin/metrics (see metrics.h)
+#define ENABLE_METRICS true
+const int METRICS_MAX_ROUTES = 24;  // Routes with their own latency histogram
 
 // NTP time sync settings
 const char* ntpServer = "pool.ntp.org";
@@ -41,19 +64,73 @@ const int daylightOffset_sec = 0;    // Daylight saving time offset
 // Pagination
 const int POSTS_PER_PAGE = 20;
 
+// HTTP keep-alive (see keepalive.h)
+#define ENABLE_KEEP_ALIVE true             // Let browsers reuse a connection for page assets
+const unsigned long KEEP_ALIVE_IDLE_MS = 2000;  // Idle connections are closed after this long
+const int KEEP_ALIVE_MAX_REQUESTS = 50;         // Requests served before a connection is closed
+
+// RAM cache for small, frequently requested static files (see assets.h)
+#define ENABLE_STATIC_CACHE true
+const int STATIC_CACHE_BYTES = 16384;          // File bytes held in RAM, in total
+const int STATIC_CACHE_ENTRIES = 8;            // Files held at once
+const int STATIC_CACHE_MAX_FILE_SIZE = 12288;  // Larger files are always streamed from SD
+const uint32_t STATIC_CACHE_MIN_FREE_HEAP = 16384;  // Files are dropped when free heap falls below this
+
+// Rendered home, /page and /archive pages (see pagecache.h)
+#define ENABLE_LISTING_CACHE true
+const int LISTING_CACHE_ENTRIES = 4;      // Listing pages kept at once
+const int LISTING_CACHE_RAM_SIZE = 2048;  // Larger pages are kept in /cache/pages instead of RAM
+const uint32_t LISTING_CACHE_MIN_FREE_HEAP = 16384;  // Pages in RAM are dropped below this free heap
+
+// Full-text search at /search (see search.h); not available with SERVE_PREBUILT_SITE
+#define ENABLE_SEARCH true
+const int SEARCH_MAX_RESULTS = 20;            // Matches listed per query
+const int SEARCH_BUILD_PAIRS = 1024;          // Most word/post pairs held in RAM while updating the index, 8 bytes each
+const uint32_t SEARCH_MIN_FREE_HEAP = 8192;   // Heap left to requests while the index is updated
+const unsigned long SEARCH_STEP_MS = 20;      // Longest a loop() spends updating the index
+
+// Serve only pages pre-rendered by tools/build_site.py into /site (see assets.h).
+// Posts, templates and routes edited on the card take effect once the site is rebuilt.
+#define SERVE_PREBUILT_SITE false
+
+// Page rendering
+const int RENDER_BUFFER_SIZE = 512;  // Bytes collected before sending a chunk
+const int MARKDOWN_LINE_SIZE = 256;  // Longer Markdown lines are rendered in pieces
+
 // ============================================================================
 // DATA STRUCTURES
 // ============================================================================
 
+// Route strings live in one NUL-separated block per table, allocated once
+// per load; entries hold offsets into it instead of separate Strings
+extern char* postMappingStrings;
+extern char* redirectionStrings;
+
 struct PostMapping {
-  String urlPath;
-  String fileName;
-  String title;
+  uint16_t urlPathOffset;
+  uint16_t fileNameOffset;
+  uint16_t titleOffset;
+  uint32_t pathHash;  // hashString(urlPath)
+  
+  const char* urlPath() const { return postMappingStrings + urlPathOffset; }
+  const char* fileName() const { return postMappingStrings + fileNameOffset; }
+  const char* title() const { return postMappingStrings + titleOffset; }
+  bool isBlogPost() const { return strncmp(urlPath(), "/posts/", 7) == 0; }
 };
 
 struct Redirection {
-  String fromPath;
-  String toPath;
+  uint16_t fromPathOffset;
+  uint16_t toPathOffset;
+  uint32_t pathHash;  // hashString(fromPath)
+  
+  const char* fromPath() const { return redirectionStrings + fromPathOffset; }
+  const char* toPath() const { return redirectionStrings + toPathOffset; }
+};
+
+// Open-addressing hash index from a request path to a table entry
+struct PathIndex {
+  uint16_t* slots;  // Entry index + 1, 0 = empty slot
+  uint32_t mask;    // Slot count - 1 (slot count is a power of two)
 };
 
 // ============================================================================
@@ -68,6 +145,9 @@ extern int postMappingsCount;
 extern Redirection* redirections;
 extern int redirectionsCount;
 
+extern PathIndex postMappingIndex;
+extern PathIndex redirectionIndex;
+
 extern String logoBase64;
 
 #endif // CONFIG_H
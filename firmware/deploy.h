@@ -0,0 +1,490 @@
+/*
+ * deploy.h - Bulk Content Updates
+ *
+ * /admin/deploy takes a tar archive, optionally gzipped, as a file upload
+ * and extracts it onto the SD card while it arrives, so a multi-megabyte
+ * update needs one request and a fixed amount of RAM. With ?staged=1 the
+ * files go to /deploy first and are moved into place only once the whole
+ * archive has arrived intact. Build bundles with tools/deploy.py.
+ */
+
+#ifndef DEPLOY_H
+#define DEPLOY_H
+
+#if ENABLE_ADMIN_PANEL && ENABLE_DEPLOY
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include <SD.h>
+#include "config.h"
+#include "storage.h"
+#include "inflate.h"
+#include "initializer.h"
+#include "assets.h"
+#include "admin.h"
+
+#define DEPLOY_STAGING_DIR "/deploy"
+
+const size_t TAR_BLOCK_SIZE = 512;
+const size_t TAR_NAME_SIZE = 256;
+
+enum TarState : uint8_t {
+  TAR_HEADER,    // Collecting a 512-byte header
+  TAR_DATA,      // Entry data: written, collected as a long name, or skipped
+  TAR_PADDING,   // Zeros up to the next 512-byte boundary
+  TAR_END        // Two zero blocks seen; the rest is ignored
+};
+
+enum TarEntry : uint8_t { ENTRY_SKIP, ENTRY_FILE, ENTRY_LONG_NAME, ENTRY_PAX };
+
+// Everything one deploy needs, allocated when it starts
+struct Deploy {
+  bool authorized;
+  bool staged;
+  bool failed;
+  String error;
+  GzipInflater* inflater;  // nullptr for a plain tar
+  bool sniffed;            // First bytes checked for the gzip magic
+  
+  TarState state;
+  TarEntry entry;
+  uint8_t header[TAR_BLOCK_SIZE];
+  size_t headerLength;
+  uint32_t remaining;      // Bytes left in the current entry's data
+  uint32_t padding;
+  int zeroBlocks;
+  char longName[TAR_NAME_SIZE];  // Name for the next entry, from a GNU or pax header
+  size_t longNameLength;
+  
+  int filesWritten;
+  int entriesSkipped;
+  uint32_t bytesWritten;
+  unsigned long startedAt;
+};
+
+Deploy* deploy = nullptr;
+
+void failDeploy(const String& error) {
+  if (deploy->failed) return;
+  deploy->failed = true;
+  deploy->error = error;
+  
+  // A file cut off by the error is never renamed into place
+  if (deploy->entry == ENTRY_FILE && deploy->state == TAR_DATA) {
+    abortAdminWrite();
+    deploy->entry = ENTRY_SKIP;
+  }
+}
+
+// ============================================================================
+// DIRECTORY HELPERS
+// ============================================================================
+
+// Removes dirPath and everything under it
+void removeTree(const String& dirPath) {
+  File dir = openFile(dirPath);
+  if (!dir) return;
+  if (!dir.isDirectory()) {
+    dir.close();
+    SD.remove(dirPath);
+    return;
+  }
+  
+  while (true) {
+    File entry = dir.openNextFile();
+    if (!entry) break;
+    String name = String(entry.name());
+    name = name.substring(name.lastIndexOf('/') + 1);
+    bool isDirectory = entry.isDirectory();
+    entry.close();
+    
+    String path = dirPath + "/" + name;
+    if (isDirectory) {
+      removeTree(path);
+    } else {
+      SD.remove(path);
+    }
+    yield();
+  }
+  dir.close();
+  SD.rmdir(dirPath);
+}
+
+// Moves every file under fromDir to the same place under toDir, replacing
+// what is there. Returns the number of files that could not be moved.
+int moveTree(const String& fromDir, const String& toDir) {
+  File dir = openFile(fromDir);
+  if (!dir || !dir.isDirectory()) return 0;
+  
+  int failures = 0;
+  while (true) {
+    File entry = dir.openNextFile();
+    if (!entry) break;
+    String name = String(entry.name());
+    name = name.substring(name.lastIndexOf('/') + 1);
+    bool isDirectory = entry.isDirectory();
+    entry.close();
+    
+    String from = fromDir + "/" + name;
+    String to = toDir + "/" + name;
+    if (isDirectory) {
+      SD.mkdir(to);
+      failures += moveTree(from, to);
+      SD.rmdir(from);
+    } else {
+      SD.remove(to);
+      if (!SD.rename(from, to)) {
+        Serial.println("ERROR: Could not move " + from);
+        failures++;
+      }
+    }
+    yield();
+  }
+  dir.close();
+  return failures;
+}
+
+// ============================================================================
+// TAR EXTRACTION
+// ============================================================================
+
+// Numeric header field: octal digits, padded with spaces or NULs
+uint32_t parseTarNumber(const uint8_t* field, size_t length) {
+  uint32_t value = 0;
+  size_t i = 0;
+  while (i < length && field[i] == ' ') i++;
+  for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+    value = (value << 3) | (field[i] - '0');
+  }
+  return value;
+}
+
+bool validTarChecksum(const uint8_t* header) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < TAR_BLOCK_SIZE; i++) {
+    sum += (i >= 148 && i < 156) ? ' ' : header[i];
+  }
+  return sum == parseTarNumber(header + 148, 8);
+}
+
+// SD card path for an archive member, or "" for one that is skipped.
+// Fails the deploy for names that would escape the card's root.
+String deployPathFor(String name) {
+  while (name.startsWith("./") || name.startsWith("/")) {
+    name = name.substring(name.startsWith("/") ? 1 : 2);
+  }
+  if (name == ".." || name.startsWith("../") || name.indexOf("/../") >= 0 || name.endsWith("/..")) {
+    failDeploy("Unsafe path in archive: " + name);
+    return "";
+  }
+  
+  // The server's own files are never replaced by a deploy
+  String path = "/" + name;
+  if (name.length() == 0 || path.startsWith(DEPLOY_STAGING_DIR "/") ||
+      path.startsWith("/cache/") || path.startsWith(ACCESS_LOG_DIR "/")) {
+    return "";
+  }
+  return deploy->staged ? DEPLOY_STAGING_DIR + path : path;
+}
+
+// Finds path= in pax extended header records ("<length> path=<value>\n")
+bool readPaxPath(char* records, size_t length) {
+  size_t pos = 0;
+  while (pos < length) {
+    char* record = records + pos;
+    size_t recordLength = strtoul(record, nullptr, 10);
+    if (recordLength == 0 || pos + recordLength > length) return false;
+    
+    char* key = strchr(record, ' ');
+    if (key && key < record + recordLength && strncmp(key + 1, "path=", 5) == 0) {
+      size_t valueLength = record + recordLength - (key + 6) - 1;
+      memmove(deploy->longName, key + 6, valueLength);
+      deploy->longName[valueLength] = '\0';
+      deploy->longNameLength = valueLength;
+      return true;
+    }
+    pos += recordLength;
+  }
+  return false;
+}
+
+void finishTarEntry() {
+  if (deploy->entry == ENTRY_FILE) {
+    if (commitAdminWrite()) {
+      deploy->filesWritten++;
+    } else {
+      failDeploy("Could not write " + adminWrite.path);
+    }
+  } else if (deploy->entry == ENTRY_LONG_NAME) {
+    deploy->longName[deploy->longNameLength] = '\0';
+  } else if (deploy->entry == ENTRY_PAX) {
+    deploy->longName[min(deploy->longNameLength, TAR_NAME_SIZE - 1)] = '\0';
+    if (!readPaxPath(deploy->longName, deploy->longNameLength)) deploy->longNameLength = 0;
+  }
+  
+  deploy->state = deploy->padding > 0 ? TAR_PADDING : TAR_HEADER;
+}
+
+void readTarHeader() {
+  const uint8_t* header = deploy->header;
+  deploy->headerLength = 0;
+  
+  // Two zero blocks end the archive
+  bool zero = true;
+  for (size_t i = 0; i < TAR_BLOCK_SIZE && zero; i++) zero = (header[i] == 0);
+  if (zero) {
+    if (++deploy->zeroBlocks == 2) deploy->state = TAR_END;
+    return;
+  }
+  deploy->zeroBlocks = 0;
+  
+  if (!validTarChecksum(header)) {
+    failDeploy("Not a tar archive, or a corrupt one");
+    return;
+  }
+  
+  uint32_t size = parseTarNumber(header + 124, 12);
+  deploy->remaining = size;
+  deploy->padding = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+  char type = header[156];
+  
+  // A long name from the previous entry applies to this one only
+  String name;
+  if (deploy->longNameLength > 0) {
+    name = deploy->longName;
+    deploy->longNameLength = 0;
+  } else {
+    char shortName[TAR_NAME_SIZE];
+    size_t length = 0;
+    if (memcmp(header + 257, "ustar", 5) == 0 && header[345] != 0) {
+      length = strnlen((const char*)header + 345, 155);
+      memcpy(shortName, header + 345, length);
+      shortName[length++] = '/';
+    }
+    size_t nameLength = strnlen((const char*)header, 100);
+    memcpy(shortName + length, header, nameLength);
+    shortName[length + nameLength] = '\0';
+    name = shortName;
+  }
+  
+  deploy->entry = ENTRY_SKIP;
+  if (type == 'L' || type == 'x') {
+    if (size >= TAR_NAME_SIZE) {
+      failDeploy("Path longer than " + String(TAR_NAME_SIZE - 1) + " bytes in archive");
+      return;
+    }
+    deploy->entry = (type == 'L') ? ENTRY_LONG_NAME : ENTRY_PAX;
+    deploy->longNameLength = 0;
+  } else if (type == '0' || type == '\0' || type == '7') {
+    String path = deployPathFor(name);
+    if (deploy->failed) return;
+    if (path.length() == 0) {
+      deploy->entriesSkipped++;
+    } else {
+      int lastSlash = path.lastIndexOf('/');
+      if (lastSlash > 0) SD.mkdir(path.substring(0, lastSlash));
+      beginAdminWrite(path);
+      if (adminWrite.failed) {
+        failDeploy("Could not create " + path);
+        return;
+      }
+      deploy->entry = ENTRY_FILE;
+      deploy->bytesWritten += size;
+    }
+  } else if (type != '5' && type != 'g') {
+    // Links and devices have no place on a FAT card
+    deploy->entriesSkipped++;
+  }
+  
+  deploy->state = TAR_DATA;
+  if (size == 0) finishTarEntry();
+}
+
+// Consumes tar data in pieces of any size
+void extractTar(const uint8_t* data, size_t length) {
+  while (length > 0 && !deploy->failed) {
+    size_t n;
+    switch (deploy->state) {
+      case TAR_HEADER:
+        n = min(length, TAR_BLOCK_SIZE - deploy->headerLength);
+        memcpy(deploy->header + deploy->headerLength, data, n);
+        deploy->headerLength += n;
+        if (deploy->headerLength == TAR_BLOCK_SIZE) readTarHeader();
+        break;
+      
+      case TAR_DATA:
+        n = min(length, (size_t)deploy->remaining);
+        if (deploy->entry == ENTRY_FILE) {
+          writeAdminBlock(data, n);
+        } else if (deploy->entry == ENTRY_LONG_NAME || deploy->entry == ENTRY_PAX) {
+          size_t kept = min(n, TAR_NAME_SIZE - 1 - deploy->longNameLength);
+          memcpy(deploy->longName + deploy->longNameLength, data, kept);
+          deploy->longNameLength += kept;
+        }
+        deploy->remaining -= n;
+        if (deploy->remaining == 0) finishTarEntry();
+        break;
+      
+      case TAR_PADDING:
+        n = min(length, (size_t)deploy->padding);
+        deploy->padding -= n;
+        if (deploy->padding == 0) deploy->state = TAR_HEADER;
+        break;
+      
+      default:
+        return;
+    }
+    data += n;
+    length -= n;
+  }
+}
+
+void inflatedTarData(const uint8_t* data, size_t length) {
+  extractTar(data, length);
+}
+
+// ============================================================================
+// DEPLOY HANDLERS
+// ============================================================================
+
+void startDeploy() {
+  delete deploy;
+  deploy = new Deploy();
+  deploy->authorized = checkAuth();
+  deploy->staged = server.arg("staged") == "1";
+  deploy->startedAt = millis();
+  if (!deploy->authorized) {
+    deploy->failed = true;
+    return;
+  }
+  
+  #if ENABLE_TRAFFIC_LOG
+  flushTrafficLog();
+  #endif
+  #if ENABLE_STATIC_CACHE
+  clearStaticCache();  // Reloaded at the end anyway; frees RAM for the gzip window
+  #endif
+  
+  if (deploy->staged) {
+    removeTree(DEPLOY_STAGING_DIR);  // Left over from an interrupted deploy
+    SD.mkdir(DEPLOY_STAGING_DIR);
+  }
+}
+
+void writeDeployData(const uint8_t* data, size_t length) {
+  if (deploy->failed) return;
+  
+  if (!deploy->sniffed) {
+    deploy->sniffed = true;
+    if (length >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+      if (ESP.getFreeHeap() < DEPLOY_GZIP_WINDOW + DEPLOY_MIN_FREE_HEAP) {
+        failDeploy("Not enough memory for a gzip bundle, send a plain tar");
+        return;
+      }
+      deploy->inflater = new GzipInflater(DEPLOY_GZIP_WINDOW, inflatedTarData);
+    }
+  }
+  
+  if (deploy->inflater) {
+    if (!deploy->inflater->write(data, length)) failDeploy(deploy->inflater->error());
+  } else {
+    extractTar(data, length);
+  }
+}
+
+void finishDeployData() {
+  if (deploy->failed) return;
+  
+  if (deploy->inflater && !deploy->inflater->finish()) {
+    failDeploy(deploy->inflater->error());
+  } else if (deploy->state != TAR_END && !deploy->failed) {
+    failDeploy("Archive ended early");
+  }
+}
+
+// Applies or discards what was extracted, reloads once if anything live
+// changed and frees the deploy. Returns the report for the client.
+String closeDeploy(int& status) {
+  String report;
+  bool changed = deploy->filesWritten > 0 && !deploy->staged;
+  
+  if (deploy->staged) {
+    if (!deploy->failed) {
+      int failures = moveTree(DEPLOY_STAGING_DIR, "");
+      changed = deploy->filesWritten > 0;
+      if (failures > 0) {
+        failDeploy(String(failures) + " files could not be moved into place");
+      }
+    }
+    removeTree(DEPLOY_STAGING_DIR);
+  }
+  
+  if (deploy->failed) {
+    status = 400;
+    report = "Deploy failed: " + deploy->error + "\n";
+    report += changed ? String(deploy->filesWritten) + " files were written before the error\n"
+                      : String("Nothing was changed\n");
+  } else {
+    status = 200;
+    report = "Deployed " + String(deploy->filesWritten) + " files (" + String(deploy->bytesWritten) + " bytes";
+    if (deploy->inflater) report += ", " + String(deploy->inflater->totalOut()) + " bytes of tar";
+    report += ") in " + String(millis() - deploy->startedAt) + " ms\n";
+    if (deploy->entriesSkipped > 0) {
+      report += "Skipped " + String(deploy->entriesSkipped) + " entries (links, /cache or /logs)\n";
+    }
+  }
+  
+  // One reload picks up routes, templates, posts and static files together
+  if (changed) {
+    reloadConfigurations();
+  }
+  
+  delete deploy->inflater;
+  delete deploy;
+  deploy = nullptr;
+  Serial.print(report);
+  return report;
+}
+
+// Upload handler: the archive is extracted as each block arrives
+void handleAdminDeployData() {
+  HTTPUpload& upload = server.upload();
+  
+  if (upload.status == UPLOAD_FILE_START) {
+    startDeploy();
+  } else if (!deploy) {
+    return;
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    writeDeployData(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    finishDeployData();
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    failDeploy("Upload aborted");
+    int status;
+    closeDeploy(status);
+  }
+}
+
+void handleAdminDeploy() {
+  if (!checkAuth()) {
+    if (deploy) {
+      delete deploy->inflater;
+      delete deploy;
+      deploy = nullptr;
+    }
+    requestAuth();
+    return;
+  }
+  if (!deploy) {
+    sendResponse(400, "text/plain", "No archive received. Send it as a file upload: curl -F bundle=@site.tar.gz\n");
+    return;
+  }
+  
+  int status;
+  String report = closeDeploy(status);
+  sendResponse(status, "text/plain", report);
+}
+
+#endif // ENABLE_ADMIN_PANEL && ENABLE_DEPLOY
+
+#endif // DEPLOY_H
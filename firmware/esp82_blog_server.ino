@@ -22,10 +22,24 @@
  *   - esp82_blog_server_modular.ino - Main entry point (this file)
  *   - config.h                      - Configuration and global variables
  *   - initializer.h                 - System initialization
+ *   - storage.h                     - Buffered SD card I/O
  *   - logger.h                      - Traffic logging
+ *   - stats.h                       - Traffic statistics
  *   - parser.h                      - Template and content parsing
+ *   - postindex.h                   - Post preview and metadata index
+ *   - routes.h                      - Route table hash lookup
+ *   - renderer.h                    - Streaming page rendering
+ *   - markdown.h                    - Markdown to HTML rendering
+ *   - pagecache.h                   - Rendered post page cache
+ *   - search.h                      - Full-text search index
+ *   - httpcache.h                   - ETag/Last-Modified and 304 replies
+ *   - assets.h                      - Static files, gzip sidecars, RAM cache, prebuilt site
+ *   - keepalive.h                   - Persistent HTTP connections
+ *   - metrics.h                     - Handler timing and /admin/metrics
  *   - server.h                      - Web server route handlers
  *   - admin.h                       - Admin panel functionality
+ *   - inflate.h                     - Streaming gzip decompression
+ *   - deploy.h                      - Bulk tar / tar.gz deploys
  */
 
 #include <ESP8266WiFi.h>
@@ -36,11 +50,25 @@
 
 // Include all module headers
 #include "config.h"
+#include "storage.h"
 #include "logger.h"
+#include "stats.h"
 #include "parser.h"
+#include "postindex.h"
+#include "routes.h"
+#include "renderer.h"
+#include "markdown.h"
+#include "pagecache.h"
+#include "search.h"
+#include "httpcache.h"
+#include "assets.h"
+#include "keepalive.h"
+#include "metrics.h"
 #include "initializer.h"
 #include "server.h"
 #include "admin.h"
+#include "inflate.h"
+#include "deploy.h"
 
 // ============================================================================
 // GLOBAL VARIABLE DEFINITIONS
@@ -49,11 +77,16 @@
 ESP8266WebServer server(80);
 
 PostMapping* postMappings = nullptr;
+char* postMappingStrings = nullptr;
 int postMappingsCount = 0;
 
 Redirection* redirections = nullptr;
+char* redirectionStrings = nullptr;
 int redirectionsCount = 0;
 
+PathIndex postMappingIndex = { nullptr, 0 };
+PathIndex redirectionIndex = { nullptr, 0 };
+
 String logoBase64 = "";
 
 // ============================================================================
@@ -61,27 +94,55 @@ String logoBase64 = "";
 // ============================================================================
 
 void setupRoutes() {
-  server.collectHeaders("User-Agent");
+  server.collectHeaders("User-Agent", "If-None-Match", "If-Modified-Since", "Accept-Encoding");
+  
+  // Each handler is timed() under the route name shown in /admin/metrics
+  server.on("/", HTTP_GET, timed("/", handleLandingPage));
+  server.on("/page", HTTP_GET, timed("/page", handlePaginatedPage));
+  server.on("/archive", HTTP_GET, timed("/archive", handleArchive));
+  #if ENABLE_SEARCH && !SERVE_PREBUILT_SITE
+  server.on("/search", HTTP_GET, timed("/search", handleSearch));
+  #endif
+  server.on("/style.css", HTTP_GET, timed("/style.css", handleCSS));
   
-  server.on("/", HTTP_GET, handleLandingPage);
-  server.on("/page", HTTP_GET, handlePaginatedPage);
-  server.on("/archive", HTTP_GET, handleArchive);
-  server.on("/style.css", HTTP_GET, handleCSS);
+  // HEAD gets the same headers as GET without the body
+  server.on("/", HTTP_HEAD, timed("/", handleLandingPage));
+  server.on("/page", HTTP_HEAD, timed("/page", handlePaginatedPage));
+  server.on("/archive", HTTP_HEAD, timed("/archive", handleArchive));
+  #if ENABLE_SEARCH && !SERVE_PREBUILT_SITE
+  server.on("/search", HTTP_HEAD, timed("/search", handleSearch));
+  #endif
+  server.on("/style.css", HTTP_HEAD, timed("/style.css", handleCSS));
   
   #if ENABLE_ADMIN_PANEL
-  server.on("/admin", HTTP_GET, handleAdminPanel);
-  server.on("/admin/files", HTTP_GET, handleAdminFiles);
-  server.on("/admin/edit", HTTP_GET, handleAdminEdit);
-  server.on("/admin/save", HTTP_POST, handleAdminSave);
-  server.on("/admin/upload", HTTP_POST, []() {
-    server.send(200);
-  }, handleAdminUpload);
-  server.on("/admin/delete", HTTP_POST, handleAdminDelete);
-  server.on("/admin/reload", HTTP_POST, handleAdminReload);
-  server.on("/admin/logs", HTTP_GET, handleAdminLogs);
-  #endif
-  
-  server.onNotFound(handleRequest);
+  server.on("/admin", HTTP_GET, timed("/admin", handleAdminPanel));
+  server.on("/admin/files", HTTP_GET, timed("/admin/files", handleAdminFiles));
+  server.on("/admin/edit", HTTP_GET, timed("/admin/edit", handleAdminEdit));
+  server.on("/admin/save", HTTP_POST, timed("/admin/save", handleAdminSave),
+            timed("/admin/save (data)", handleAdminSaveData));
+  server.on("/admin/upload", HTTP_POST, timed("/admin/upload", handleAdminUpload),
+            timed("/admin/upload (data)", handleAdminUploadData));
+  server.on("/admin/delete", HTTP_POST, timed("/admin/delete", handleAdminDelete));
+  server.on("/admin/reload", HTTP_POST, timed("/admin/reload", handleAdminReload));
+  #if ENABLE_DEPLOY
+  server.on("/admin/deploy", HTTP_POST, timed("/admin/deploy", handleAdminDeploy),
+            timed("/admin/deploy (data)", handleAdminDeployData));
+  #endif
+  server.on("/admin/logs", HTTP_GET, timed("/admin/logs", handleAdminLogs));
+  #if ENABLE_TRAFFIC_STATS
+  server.on("/admin/stats", HTTP_GET, timed("/admin/stats", handleAdminStats));
+  #endif
+  #if ENABLE_METRICS
+  server.on("/admin/metrics", HTTP_GET, timed("/admin/metrics", handleAdminMetrics));
+  #endif
+  #endif
+  
+  // Posts, static files, redirects and 404s
+  server.onNotFound(timed("other", handleRequest));
+  
+  #if ENABLE_KEEP_ALIVE
+  setupKeepAlive();
+  #endif
 }
 
 // ============================================================================
@@ -108,7 +169,24 @@ void setup() {
   // Load configurations
   loadPostMappings();
   loadRedirections();
+  #if SERVE_PREBUILT_SITE
+  loadPrebuiltSite();  // Pages come from /site; nothing is rendered here
+  #else
+  loadTemplateCache();
+  loadPostIndex();
+  clearPageCache();  // Posts or templates may have been edited off-device
+  #if ENABLE_SEARCH
+  loadSearchIndex();  // Brought up to date from loop()
+  #endif
+  #endif
+  loadGzipIndex();
   loadLogo();
+  #if ENABLE_TRAFFIC_LOG
+  initTrafficLog();
+  #endif
+  #if ENABLE_TRAFFIC_STATS
+  loadTrafficStats();
+  #endif
   
   // Connect to WiFi
   connectWiFi();
@@ -124,7 +202,6 @@ void setup() {
   Serial.println("HTTP server started");
   Serial.print("Access blog at: http://");
   Serial.println(WiFi.localIP());
-  Serial.println("Note: Admin panel works best with files <4KB. Large files should be edited via SD card.");
   
   Serial.println("\n=== Initialization Complete ===");
   Serial.printf("Posts loaded: %d\n", postMappingsCount);
@@ -143,4 +220,28 @@ void loop() {
   
   // Handle web requests
   server.handleClient();
+  
+  // Write buffered log entries while no request is waiting
+  #if ENABLE_TRAFFIC_LOG
+  serviceTrafficLog();
+  #endif
+  #if ENABLE_TRAFFIC_STATS
+  serviceTrafficStats();
+  #endif
+  
+  #if ENABLE_KEEP_ALIVE
+  closeIdleConnection();
+  #endif
+  
+  #if ENABLE_STATIC_CACHE
+  trimStaticCache();
+  #endif
+  #if ENABLE_LISTING_CACHE
+  trimListingCache();
+  #endif
+  
+  // Re-reads changed posts or merges part of the index, if an update is pending
+  #if ENABLE_SEARCH && !SERVE_PREBUILT_SITE
+  serviceSearchIndex();
+  #endif
 }
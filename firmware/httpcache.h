@@ -0,0 +1,129 @@
+/*
+ * httpcache.h - HTTP Conditional Requests
+ *
+ * ETag and Last-Modified validators, and 304 Not Modified replies for
+ * clients that already hold the current version of a response
+ */
+
+#ifndef HTTPCACHE_H
+#define HTTPCACHE_H
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include <SD.h>
+#include <time.h>
+#include "config.h"
+#include "parser.h"
+#include "logger.h"
+
+// ============================================================================
+// VALIDATORS
+// ============================================================================
+
+// Folds a value into a running FNV-1a hash
+uint32_t hashCombine(uint32_t hash, uint32_t value) {
+  return hashBytes(&value, sizeof(value), hash);
+}
+
+// Strong entity tag for a response fingerprint
+String makeETag(uint32_t hash) {
+  char etag[12];
+  snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)hash);
+  return String(etag);
+}
+
+// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+String httpDate(time_t t) {
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char date[32];
+  strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return String(date);
+}
+
+// Static files are identified by size and modification time, like most servers do
+String fileETag(File& file) {
+  return makeETag(hashCombine(hashCombine(2166136261UL, file.size()), file.getLastWrite()));
+}
+
+// Parses an IMF-fixdate; returns 0 for anything else
+time_t parseHttpDate(const String& date) {
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char monthName[4];
+  int day, year, hour, minute, second;
+  
+  if (sscanf(date.c_str(), "%*3s, %d %3s %d %d:%d:%d", &day, monthName, &year, &hour, &minute, &second) != 6) {
+    return 0;
+  }
+  const char* found = strstr(months, monthName);
+  if (strlen(monthName) != 3 || !found || (found - months) % 3 != 0) return 0;
+  int month = (found - months) / 3 + 1;
+  
+  // Days since 1970-01-01 in the proleptic Gregorian calendar, without
+  // mktime(), which would apply the configured time zone
+  int y = year - (month <= 2);
+  int era = y / 400;
+  int yearOfEra = y - era * 400;
+  int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  long days = (long)era * 146097 + dayOfEra - 719468;
+  
+  return (time_t)days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+// ============================================================================
+// CONDITIONAL REQUESTS
+// ============================================================================
+
+// True if an If-None-Match list ("*", or tags with optional W/) names etag
+bool etagMatches(const String& header, const String& etag) {
+  int start = 0;
+  while (start < (int)header.length()) {
+    int end = header.indexOf(',', start);
+    if (end < 0) end = header.length();
+    
+    String tag = header.substring(start, end);
+    tag.trim();
+    if (tag.startsWith("W/")) tag = tag.substring(2);
+    if (tag == "*" || tag == etag) return true;
+    
+    start = end + 1;
+  }
+  return false;
+}
+
+// If-None-Match takes precedence; If-Modified-Since is only consulted
+// when the client sent no entity tags
+bool isNotModified(const String& etag, time_t lastModified) {
+  if (server.hasHeader("If-None-Match")) {
+    return etagMatches(server.header("If-None-Match"), etag);
+  }
+  
+  if (lastModified > 0 && server.hasHeader("If-Modified-Since")) {
+    time_t since = parseHttpDate(server.header("If-Modified-Since"));
+    return since > 0 && lastModified <= since;
+  }
+  return false;
+}
+
+// Adds the validators to the response. Returns true if the client's copy is
+// current, in which case a 304 has already been sent and the caller is done.
+bool sendValidators(const String& etag, time_t lastModified) {
+  server.sendHeader("ETag", etag);
+  if (lastModified > 0) {
+    server.sendHeader("Last-Modified", httpDate(lastModified));
+  }
+  
+  if (!isNotModified(etag, lastModified)) {
+    return false;
+  }
+  
+  #if ENABLE_TRAFFIC_LOG
+  logTraffic(304);
+  #endif
+  
+  server.send(304);
+  return true;
+}
+
+#endif // HTTPCACHE_H
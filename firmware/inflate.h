@@ -0,0 +1,429 @@
+/*
+ * inflate.h - Streaming gzip Decompression
+ *
+ * Decodes a gzip stream handed over in pieces of any size, as they arrive
+ * from an upload, and passes the output on in pieces. Memory use is fixed:
+ * the history window, a 1 KB input buffer and the Huffman tables. A stream
+ * that refers further back than the window is rejected, not misdecoded;
+ * tools/deploy.py compresses to fit DEPLOY_GZIP_WINDOW.
+ */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <Arduino.h>
+
+// CRC-32 as used by gzip; pass a previous result as crc to continue it
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+// Receives decompressed data in the order it was decoded
+typedef void (*InflateOutput)(const uint8_t* data, size_t length);
+
+class GzipInflater {
+ public:
+  // windowSize must be a power of two
+  GzipInflater(size_t windowSize, InflateOutput output)
+      : window(new uint8_t[windowSize]), windowMask(windowSize - 1), output(output) {}
+  
+  ~GzipInflater() {
+    delete[] window;
+  }
+  
+  // Decodes as much of data as possible. Returns false once the stream is
+  // found to be invalid; error() says why.
+  bool write(const uint8_t* data, size_t length) {
+    while (length > 0 && !failure) {
+      if (inputStart > 0) {
+        memmove(input, input + inputStart, inputEnd - inputStart);
+        inputEnd -= inputStart;
+        inputStart = 0;
+      }
+      if (inputEnd == sizeof(input)) {
+        return fail("gzip header too long");
+      }
+      
+      size_t n = min(length, sizeof(input) - inputEnd);
+      memcpy(input + inputEnd, data, n);
+      inputEnd += n;
+      data += n;
+      length -= n;
+      run(false);
+    }
+    flushWindow();
+    return !failure;
+  }
+  
+  // Decodes what is left once all input has been written. Returns true if
+  // the stream was complete and its checksum and length match.
+  bool finish() {
+    run(true);
+    flushWindow();
+    if (!failure && state != INFLATE_DONE) fail("gzip stream truncated");
+    return !failure;
+  }
+  
+  const char* error() const { return failure; }
+  uint32_t totalOut() const { return outputPosition; }
+ 
+ private:
+  enum State : uint8_t { INFLATE_HEADER, INFLATE_BLOCK, INFLATE_STORED, INFLATE_CODES, INFLATE_TRAILER, INFLATE_DONE };
+  
+  // Canonical Huffman code: codes per length and symbols in code order
+  struct Huffman {
+    int16_t count[16];
+    int16_t symbol[288];
+  };
+  
+  // Input a block header or a length/distance pair can need at most, so
+  // neither is ever started without all of its bits at hand
+  static const size_t BLOCK_HEADER_MARGIN = 320;
+  static const size_t SYMBOL_MARGIN = 8;
+  
+  uint8_t* window;
+  uint32_t windowMask;
+  InflateOutput output;
+  
+  uint8_t input[1024];
+  size_t inputStart = 0;
+  size_t inputEnd = 0;
+  uint32_t bitBuffer = 0;
+  int bitCount = 0;
+  
+  State state = INFLATE_HEADER;
+  bool lastBlock = false;
+  uint32_t storedRemaining = 0;
+  Huffman lengthCode;
+  Huffman distanceCode;
+  
+  uint32_t outputPosition = 0;  // Bytes decoded
+  uint32_t outputFlushed = 0;   // Bytes passed to output
+  uint32_t crc = 0;
+  const char* failure = nullptr;
+  
+  bool fail(const char* message) {
+    if (!failure) failure = message;
+    return false;
+  }
+  
+  size_t available() const {
+    return (inputEnd - inputStart) + bitCount / 8;
+  }
+  
+  // Next n bits (n <= 16), least significant first
+  uint32_t bits(int n) {
+    while (bitCount < n) {
+      if (inputStart == inputEnd) {
+        fail("gzip stream truncated");
+        return 0;
+      }
+      bitBuffer |= (uint32_t)input[inputStart++] << bitCount;
+      bitCount += 8;
+    }
+    uint32_t value = bitBuffer & ((1UL << n) - 1);
+    bitBuffer >>= n;
+    bitCount -= n;
+    return value;
+  }
+  
+  void alignToByte() {
+    bitBuffer >>= bitCount % 8;
+    bitCount -= bitCount % 8;
+  }
+  
+  // ==========================================================================
+  // OUTPUT
+  // ==========================================================================
+  
+  void put(uint8_t byte) {
+    window[outputPosition & windowMask] = byte;
+    outputPosition++;
+    if (outputPosition - outputFlushed > windowMask) flushWindow();
+  }
+  
+  // Hands everything decoded since the last flush to output, before the
+  // window wraps around and overwrites it
+  void flushWindow() {
+    while (outputFlushed != outputPosition) {
+      uint32_t start = outputFlushed & windowMask;
+      uint32_t n = min(outputPosition - outputFlushed, windowMask + 1 - start);
+      crc = crc32Update(crc, window + start, n);
+      output(window + start, n);
+      outputFlushed += n;
+    }
+  }
+  
+  // ==========================================================================
+  // HUFFMAN CODES
+  // ==========================================================================
+  
+  // Builds a code from code lengths. Returns 0 for a complete code, > 0 for
+  // an incomplete one and < 0 for an over-subscribed (invalid) one.
+  int buildCode(Huffman& code, const uint8_t* lengths, int n) {
+    memset(code.count, 0, sizeof(code.count));
+    for (int i = 0; i < n; i++) code.count[lengths[i]]++;
+    if (code.count[0] == n) return 0;
+    
+    int left = 1;
+    for (int len = 1; len < 16; len++) {
+      left <<= 1;
+      left -= code.count[len];
+      if (left < 0) return left;
+    }
+    
+    int16_t offsets[16];
+    offsets[1] = 0;
+    for (int len = 1; len < 15; len++) offsets[len + 1] = offsets[len] + code.count[len];
+    for (int i = 0; i < n; i++) {
+      if (lengths[i] != 0) code.symbol[offsets[lengths[i]]++] = i;
+    }
+    return left;
+  }
+  
+  // Reads one symbol a bit at a time; slow but needs no lookup tables
+  int decodeSymbol(const Huffman& code) {
+    int value = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+      value |= bits(1);
+      int count = code.count[len];
+      if (value - count < first) return code.symbol[index + (value - first)];
+      index += count;
+      first += count;
+      first <<= 1;
+      value <<= 1;
+    }
+    fail("invalid gzip data");
+    return -1;
+  }
+  
+  void buildFixedCodes() {
+    uint8_t lengths[288];
+    int i = 0;
+    for (; i < 144; i++) lengths[i] = 8;
+    for (; i < 256; i++) lengths[i] = 9;
+    for (; i < 280; i++) lengths[i] = 7;
+    for (; i < 288; i++) lengths[i] = 8;
+    buildCode(lengthCode, lengths, 288);
+    
+    for (i = 0; i < 30; i++) lengths[i] = 5;
+    buildCode(distanceCode, lengths, 30);
+  }
+  
+  bool readDynamicCodes() {
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint8_t lengths[286 + 30];
+    
+    int lengthCount = bits(5) + 257;
+    int distanceCount = bits(5) + 1;
+    int codeCount = bits(4) + 4;
+    if (lengthCount > 286 || distanceCount > 30) return fail("invalid gzip data");
+    
+    memset(lengths, 0, 19);
+    for (int i = 0; i < codeCount; i++) lengths[order[i]] = bits(3);
+    if (buildCode(lengthCode, lengths, 19) != 0) return fail("invalid gzip data");
+    
+    int index = 0;
+    while (index < lengthCount + distanceCount && !failure) {
+      int symbol = decodeSymbol(lengthCode);
+      if (symbol < 16) {
+        lengths[index++] = symbol;
+        continue;
+      }
+      
+      uint8_t repeated = 0;
+      int times;
+      if (symbol == 16) {
+        if (index == 0) return fail("invalid gzip data");
+        repeated = lengths[index - 1];
+        times = 3 + bits(2);
+      } else if (symbol == 17) {
+        times = 3 + bits(3);
+      } else {
+        times = 11 + bits(7);
+      }
+      if (index + times > lengthCount + distanceCount) return fail("invalid gzip data");
+      while (times--) lengths[index++] = repeated;
+    }
+    if (failure || lengths[256] == 0) return fail("invalid gzip data");
+    
+    // Incomplete codes are only allowed when they have a single symbol
+    int err = buildCode(lengthCode, lengths, lengthCount);
+    if (err < 0 || (err > 0 && lengthCount - lengthCode.count[0] != 1)) return fail("invalid gzip data");
+    err = buildCode(distanceCode, lengths + lengthCount, distanceCount);
+    if (err < 0 || (err > 0 && distanceCount - distanceCode.count[0] != 1)) return fail("invalid gzip data");
+    return true;
+  }
+  
+  // ==========================================================================
+  // DECODING
+  // ==========================================================================
+  
+  // Gzip member header (RFC 1952); the optional fields are skipped
+  bool readHeader(bool final) {
+    const uint8_t* p = input + inputStart;
+    size_t n = inputEnd - inputStart;
+    if (n < 10) return final ? fail("gzip stream truncated") : false;
+    if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8) return fail("not a gzip stream");
+    
+    uint8_t flags = p[3];
+    size_t end = 10;
+    if (flags & 0x04) {
+      if (n < end + 2) return final ? fail("gzip stream truncated") : false;
+      end += 2 + (p[end] | (p[end + 1] << 8));
+    }
+    for (uint8_t field = 0x08; field <= 0x10; field <<= 1) {
+      if (!(flags & field)) continue;
+      while (end < n && p[end] != 0) end++;
+      if (end++ >= n) return final ? fail("gzip stream truncated") : false;
+    }
+    if (flags & 0x02) end += 2;
+    if (end > n) return final ? fail("gzip stream truncated") : false;
+    
+    inputStart += end;
+    state = INFLATE_BLOCK;
+    return true;
+  }
+  
+  void readBlockHeader() {
+    lastBlock = bits(1);
+    int type = bits(2);
+    
+    if (type == 0) {
+      alignToByte();
+      uint32_t length = bits(16);
+      uint32_t check = bits(16);
+      if (length != (~check & 0xFFFF)) {
+        fail("invalid gzip data");
+        return;
+      }
+      storedRemaining = length;
+      state = INFLATE_STORED;
+    } else if (type == 1) {
+      buildFixedCodes();
+      state = INFLATE_CODES;
+    } else if (type == 2) {
+      if (readDynamicCodes()) state = INFLATE_CODES;
+    } else {
+      fail("invalid gzip data");
+    }
+  }
+  
+  void endBlock() {
+    state = lastBlock ? INFLATE_TRAILER : INFLATE_BLOCK;
+  }
+  
+  // Decodes literals and length/distance pairs until the block ends or the
+  // input runs low
+  void decodeCodes(bool final) {
+    static const uint16_t lengthBase[29] = {
+      3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t lengthExtra[29] = {
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t distanceBase[30] = {
+      1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+      257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t distanceExtra[30] = {
+      0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    
+    while (!failure && (final || available() >= SYMBOL_MARGIN)) {
+      int symbol = decodeSymbol(lengthCode);
+      if (failure) return;
+      if (symbol < 256) {
+        put(symbol);
+        continue;
+      }
+      if (symbol == 256) {
+        endBlock();
+        return;
+      }
+      
+      symbol -= 257;
+      if (symbol >= 29) {
+        fail("invalid gzip data");
+        return;
+      }
+      uint32_t length = lengthBase[symbol] + bits(lengthExtra[symbol]);
+      
+      int distanceSymbol = decodeSymbol(distanceCode);
+      if (distanceSymbol < 0 || distanceSymbol >= 30) {
+        fail("invalid gzip data");
+        return;
+      }
+      uint32_t distance = distanceBase[distanceSymbol] + bits(distanceExtra[distanceSymbol]);
+      if (distance > windowMask + 1) {
+        fail("gzip window too large, compress with tools/deploy.py");
+        return;
+      }
+      if (distance > outputPosition) {
+        fail("invalid gzip data");
+        return;
+      }
+      
+      while (length--) put(window[(outputPosition - distance) & windowMask]);
+    }
+  }
+  
+  void run(bool final) {
+    while (!failure) {
+      switch (state) {
+        case INFLATE_HEADER:
+          if (!readHeader(final)) return;
+          break;
+        
+        case INFLATE_BLOCK:
+          if (!final && available() < BLOCK_HEADER_MARGIN) return;
+          readBlockHeader();
+          break;
+        
+        case INFLATE_STORED:
+          while (storedRemaining > 0 && inputStart < inputEnd) {
+            put(input[inputStart++]);
+            storedRemaining--;
+          }
+          if (storedRemaining > 0) {
+            if (final) fail("gzip stream truncated");
+            return;
+          }
+          endBlock();
+          break;
+        
+        case INFLATE_CODES:
+          decodeCodes(final);
+          if (state == INFLATE_CODES) return;
+          break;
+        
+        case INFLATE_TRAILER: {
+          alignToByte();
+          if (!final && available() < 8) return;
+          flushWindow();
+          uint32_t expectedCrc = bits(16);
+          expectedCrc |= bits(16) << 16;
+          uint32_t expectedSize = bits(16);
+          expectedSize |= bits(16) << 16;
+          if (failure) return;
+          if (expectedCrc != crc || expectedSize != outputPosition) {
+            fail("gzip checksum mismatch");
+            return;
+          }
+          state = INFLATE_DONE;
+          break;
+        }
+        
+        case INFLATE_DONE:
+          inputStart = inputEnd;  // Anything after the first member is ignored
+          return;
+      }
+    }
+  }
+};
+
+#endif // INFLATE_H
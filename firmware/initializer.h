@@ -12,6 +12,13 @@
 #include <SD.h>
 #include <time.h>
 #include "config.h"
+#include "parser.h"
+#include "postindex.h"
+#include "pagecache.h"
+#include "search.h"
+#include "assets.h"
+#include "routes.h"
+#include "storage.h"
 
 // Forward declarations
 void syncTime();
@@ -149,96 +156,61 @@ void syncTime() {
 void loadPostMappings() {
   Serial.println("Loading post mappings...");
   
-  File configFile = SD.open("/config/routes.txt", FILE_READ);
-  if (!configFile) {
-    Serial.println("Failed to open /config/routes.txt");
+  int count = loadRouteFile("/config/routes.txt", "/cache/routes.bin", 3, postMappingStrings);
+  if (count < 0) {
+    Serial.println("Failed to load /config/routes.txt");
     return;
   }
   
-  // Count lines
-  int lineCount = 0;
-  while (configFile.available()) {
-    String line = configFile.readStringUntil('\n');
-    line.trim();
-    if (line.length() > 0 && !line.startsWith("#")) {
-      lineCount++;
-    }
-  }
-  
-  // Allocate array
-  postMappings = new PostMapping[lineCount];
-  postMappingsCount = 0;
-  
-  // Parse lines
-  configFile.seek(0);
-  while (configFile.available() && postMappingsCount < lineCount) {
-    String line = configFile.readStringUntil('\n');
-    line.trim();
-    
-    if (line.length() > 0 && !line.startsWith("#")) {
-      int pipe1 = line.indexOf('|');
-      int pipe2 = line.indexOf('|', pipe1 + 1);
-      
-      if (pipe1 > 0 && pipe2 > pipe1) {
-        postMappings[postMappingsCount].urlPath = line.substring(0, pipe1);
-        postMappings[postMappingsCount].fileName = line.substring(pipe1 + 1, pipe2);
-        postMappings[postMappingsCount].title = line.substring(pipe2 + 1);
-        postMappingsCount++;
-      }
-    }
+  // Each entry is urlPath, fileName and title, back to back
+  postMappings = new PostMapping[count];
+  uint16_t offset = 0;
+  for (int i = 0; i < count; i++) {
+    PostMapping& mapping = postMappings[i];
+    mapping.urlPathOffset = offset;
+    mapping.fileNameOffset = nextStringOffset(postMappingStrings, mapping.urlPathOffset);
+    mapping.titleOffset = nextStringOffset(postMappingStrings, mapping.fileNameOffset);
+    mapping.pathHash = hashString(mapping.urlPath());
+    offset = nextStringOffset(postMappingStrings, mapping.titleOffset);
   }
+  postMappingsCount = count;
+  routesVersion = hashBytes(postMappingStrings, offset);
+  routesLastWrite = getFileLastWrite("/config/routes.txt");
   
-  configFile.close();
-  Serial.printf("Loaded %d post mappings\n", postMappingsCount);
+  buildPathIndex(postMappingIndex, postMappings, postMappingsCount);
+  buildBlogPostList();
+  Serial.printf("Loaded %d post mappings (%d blog posts)\n", postMappingsCount, blogPostCount);
 }
 
 void loadRedirections() {
   Serial.println("Loading redirections...");
   
-  File redirectFile = SD.open("/config/redirects.txt", FILE_READ);
-  if (!redirectFile) {
+  int count = loadRouteFile("/config/redirects.txt", "/cache/redirects.bin", 2, redirectionStrings);
+  if (count < 0) {
     Serial.println("No /config/redirects.txt found");
     return;
   }
   
-  // Count lines
-  int lineCount = 0;
-  while (redirectFile.available()) {
-    String line = redirectFile.readStringUntil('\n');
-    line.trim();
-    if (line.length() > 0 && !line.startsWith("#")) {
-      lineCount++;
-    }
-  }
-  
-  // Allocate array
-  redirections = new Redirection[lineCount];
-  redirectionsCount = 0;
-  
-  // Parse lines
-  redirectFile.seek(0);
-  while (redirectFile.available() && redirectionsCount < lineCount) {
-    String line = redirectFile.readStringUntil('\n');
-    line.trim();
-    
-    if (line.length() > 0 && !line.startsWith("#")) {
-      int pipePos = line.indexOf('|');
-      if (pipePos > 0) {
-        redirections[redirectionsCount].fromPath = line.substring(0, pipePos);
-        redirections[redirectionsCount].toPath = line.substring(pipePos + 1);
-        redirectionsCount++;
-      }
-    }
+  // Each entry is fromPath and toPath, back to back
+  redirections = new Redirection[count];
+  uint16_t offset = 0;
+  for (int i = 0; i < count; i++) {
+    Redirection& redirection = redirections[i];
+    redirection.fromPathOffset = offset;
+    redirection.toPathOffset = nextStringOffset(redirectionStrings, redirection.fromPathOffset);
+    redirection.pathHash = hashString(redirection.fromPath());
+    offset = nextStringOffset(redirectionStrings, redirection.toPathOffset);
   }
+  redirectionsCount = count;
   
-  redirectFile.close();
+  buildPathIndex(redirectionIndex, redirections, redirectionsCount);
   Serial.printf("Loaded %d redirections\n", redirectionsCount);
 }
 
 void loadLogo() {
   Serial.println("Loading logo...");
   
-  File logoFile = SD.open("/static/logo.png", FILE_READ);
+  File logoFile = openFile("/static/logo.png", FILE_READ);
   if (!logoFile) {
     Serial.println("No /static/logo.png found");
     return;
@@ -249,19 +221,43 @@ void loadLogo() {
 }
 
 void reloadConfigurations() {
-  // Free existing allocations
-  if (postMappings != nullptr) {
-    delete[] postMappings;
-    postMappings = nullptr;
-  }
-  if (redirections != nullptr) {
-    delete[] redirections;
-    redirections = nullptr;
-  }
+  // Free existing allocations; each table is one array plus one string block
+  delete[] postMappings;
+  delete[] postMappingStrings;
+  postMappings = nullptr;
+  postMappingStrings = nullptr;
+  
+  delete[] redirections;
+  delete[] redirectionStrings;
+  redirections = nullptr;
+  redirectionStrings = nullptr;
+  
+  freePathIndex(postMappingIndex);
+  freePathIndex(redirectionIndex);
+  postMappingsCount = 0;
+  redirectionsCount = 0;
+  
+  delete[] blogPosts;
+  blogPosts = nullptr;
+  blogPostCount = 0;
   
   // Reload
   loadPostMappings();
   loadRedirections();
+  #if SERVE_PREBUILT_SITE
+  loadPrebuiltSite();
+  #else
+  loadTemplateCache();
+  loadPostIndex();
+  clearPageCache();
+  #if ENABLE_SEARCH
+  loadSearchIndex();
+  #endif
+  #endif
+  loadGzipIndex();
+  #if ENABLE_STATIC_CACHE
+  clearStaticCache();
+  #endif
 }
 
 #endif // INITIALIZER_H
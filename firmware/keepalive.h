@@ -0,0 +1,68 @@
+/*
+ * keepalive.h - Persistent HTTP Connections
+ *
+ * Lets a browser fetch a page and its CSS, logo and images over one TCP
+ * connection instead of paying a handshake and lwIP PCB setup for each.
+ * The web server handles one connection at a time, so an idle one is
+ * closed quickly to let the next client in, and a connection is retired
+ * after KEEP_ALIVE_MAX_REQUESTS.
+ */
+
+#ifndef KEEPALIVE_H
+#define KEEPALIVE_H
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include "config.h"
+
+#if ENABLE_KEEP_ALIVE
+
+uint16_t connectionPort = 0;        // Remote port of the connection being served
+int connectionRequests = 0;         // Requests received on it so far
+uint32_t totalRequests = 0;
+unsigned long connectionIdleSince = 0;
+
+// Runs before each request is handled. The last request allowed on a
+// connection is answered with Connection: close.
+ESP8266WebServer::ClientFuture countConnectionRequest(const String& method, const String& url,
+                                                      WiFiClient* client, ESP8266WebServer::ContentTypeFunction contentType) {
+  if (client->remotePort() != connectionPort) {
+    connectionPort = client->remotePort();
+    connectionRequests = 0;
+  }
+  connectionRequests++;
+  totalRequests++;
+  
+  server.keepAlive(connectionRequests < KEEP_ALIVE_MAX_REQUESTS);
+  return ESP8266WebServer::CLIENT_REQUEST_CAN_CONTINUE;
+}
+
+void setupKeepAlive() {
+  server.keepAlive(true);
+  server.addHook(countConnectionRequest);
+}
+
+// Call after server.handleClient(). The server would otherwise hold an
+// idle connection for several seconds while other clients wait.
+void closeIdleConnection() {
+  static uint32_t requestsSeen = 0;
+  
+  if (totalRequests != requestsSeen) {
+    requestsSeen = totalRequests;
+    connectionIdleSince = millis();
+    return;
+  }
+  
+  // Only a connection that has been answered is idle; a new one may still
+  // be sending its first request
+  WiFiClient& client = server.client();
+  if (client.connected() && client.remotePort() == connectionPort && !client.available() &&
+      millis() - connectionIdleSince > KEEP_ALIVE_IDLE_MS) {
+    client.stop();
+    connectionPort = 0;
+  }
+}
+
+#endif // ENABLE_KEEP_ALIVE
+
+#endif // KEEPALIVE_H
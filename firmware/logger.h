@@ -1,7 +1,8 @@
 /*
  * logger.h - Traffic Logging System
  * 
- * Functions for logging HTTP requests with NTP timestamps and log rotation
+ * Functions for logging HTTP requests with NTP timestamps and log rotation.
+ * Entries are buffered in RAM and written to the SD card in batches.
  */
 
 #ifndef LOGGER_H
@@ -12,89 +13,463 @@
 #include <SD.h>
 #include <time.h>
 #include "config.h"
+#include "parser.h"
+#include "storage.h"
+#include "stats.h"
+
+#define ACCESS_LOG_DIR "/logs"
+#define ACCESS_LOG_PATH ACCESS_LOG_DIR "/access.log"      // Text format
+#define ACCESS_LOG_BIN_PATH ACCESS_LOG_DIR "/access.bin"  // Binary format records
+#define ACCESS_LOG_STR_PATH ACCESS_LOG_DIR "/access.str"  // ...and their strings
+
+// One request in the binary log format (LOG_FORMAT_BINARY). URIs and user
+// agents are stored once per log generation in the matching .str file, as
+// a kind byte ('U' or 'A') plus NUL-terminated text; IDs count entries of
+// each kind in file order.
+struct AccessLogRecord {
+  uint32_t seconds;        // Epoch time, or uptime with LOG_FLAG_UPTIME
+  uint8_t ip[4];
+  uint16_t uriId;
+  uint16_t userAgentId;
+  uint16_t status;
+  uint8_t method;          // HTTPMethod
+  uint8_t flags;
+};
+
+#define LOG_FLAG_UPTIME 0x01
+#define LOG_STRING_URI 'U'
+#define LOG_STRING_USER_AGENT 'A'
+#define LOG_STRING_MAX_LENGTH 128  // Longer URIs are truncated when interned
+
+// ============================================================================
+// LOG FORMATTING
+// ============================================================================
+
+const char* methodName(uint8_t method) {
+  static const char* const names[] = { "ANY", "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS" };
+  return (method < sizeof(names) / sizeof(names[0])) ? names[method] : "?";
+}
+
+// Renders one entry in the text log format, truncated to fit size, and
+// returns its length. Used for access.log and to display binary records.
+size_t formatLogEntry(char* entry, size_t size, uint32_t seconds, bool uptime, const uint8_t ip[4],
+                      uint8_t method, const char* uri, int status, const char* userAgent) {
+  char timestamp[32];
+  if (!uptime) {
+    time_t t = seconds;
+    struct tm timeinfo;
+    localtime_r(&t, &timeinfo);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+  } else {
+    snprintf(timestamp, sizeof(timestamp), "%lud %luh %lum %lus", (unsigned long)seconds / 86400,
+             (unsigned long)(seconds % 86400) / 3600, (unsigned long)(seconds % 3600) / 60, (unsigned long)seconds % 60);
+  }
+  
+  // Apache Combined Log Format
+  int length = snprintf(entry, size, "[%s] %u.%u.%u.%u - %s %s - %d - \"%s\"\n",
+                        timestamp, ip[0], ip[1], ip[2], ip[3], methodName(method), uri, status, userAgent);
+  if (length >= (int)size) {
+    length = size - 1;
+    entry[length - 1] = '\n';
+  }
+  return length;
+}
 
 #if ENABLE_TRAFFIC_LOG
 
-void logTraffic(int statusCode) {
-  // Get request details
-  String clientIP = server.client().remoteIP().toString();
-  String method = (server.method() == HTTP_GET) ? "GET" : "POST";
-  String uri = server.uri();
-  String userAgent = server.header("User-Agent");
+// Entries are collected here and written to the SD card in batches from
+// loop(), so a request never waits for a FAT open
+char logBuffer[LOG_BUFFER_SIZE];
+size_t logBufferLength = 0;
+unsigned long logLastEntry = 0;
+
+// Size of the current log, kept in RAM so appending never needs a size
+// check; -1 until the first write after boot or after /logs was changed
+long logFileSize = -1;
+
+#if LOG_FORMAT_BINARY
+
+// Hashes of the strings in access.str, by kind; the index is the ID
+struct LogStringTable {
+  uint32_t hashes[LOG_STRING_TABLE_SIZE];
+  int count;
+};
+
+LogStringTable logUris;
+LogStringTable logUserAgents;
+
+// New strings waiting to be appended to access.str, ahead of the records
+char logStringBuffer[LOG_STRING_BUFFER_SIZE];
+size_t logStringBufferLength = 0;
+
+// Bumped whenever the tables start afresh, so IDs from before can be spotted
+uint32_t logStringGeneration = 0;
+
+#endif // LOG_FORMAT_BINARY
+
+void flushTrafficLog();
+
+// ============================================================================
+// LOG ROTATION
+// ============================================================================
+
+// Path of rotated generation n: /logs/access.1 is the newest
+String logGenerationPath(int n, const char* suffix = "") {
+  return String(ACCESS_LOG_DIR "/access.") + String(n) + suffix;
+}
+
+// Shifts generations 1..N-1 up one place, dropping N, and makes currentPath
+// generation 1. Only renames, so it costs the same however large the logs are.
+void rotateLogFile(const char* currentPath, const char* suffix) {
+  SD.remove(logGenerationPath(LOG_GENERATIONS, suffix));
+  for (int n = LOG_GENERATIONS - 1; n >= 1; n--) {
+    SD.rename(logGenerationPath(n, suffix), logGenerationPath(n + 1, suffix));
+  }
   
-  // Handle missing or empty User-Agent
-  if (userAgent.length() == 0) {
-    userAgent = "-";  // Standard log format for missing field
-  } else if (userAgent.length() > 60) {
-    // Trim if too long
-    userAgent = userAgent.substring(0, 57) + "...";
+  if (LOG_GENERATIONS > 0) {
+    SD.rename(currentPath, logGenerationPath(1, suffix));
+  } else {
+    SD.remove(currentPath);
+  }
+}
+
+// Call with the buffer flushed: buffered binary records refer to the
+// string table this starts afresh
+void rotateTrafficLog() {
+  #if LOG_FORMAT_BINARY
+  rotateLogFile(ACCESS_LOG_BIN_PATH, ".bin");
+  rotateLogFile(ACCESS_LOG_STR_PATH, ".str");
+  logUris.count = 0;
+  logUserAgents.count = 0;
+  logStringGeneration++;
+  Serial.println("LOG: Rotated access.bin to access.1.bin");
+  #else
+  rotateLogFile(ACCESS_LOG_PATH, "");
+  Serial.println("LOG: Rotated access.log to access.1");
+  #endif
+  logFileSize = 0;
+}
+
+// ============================================================================
+// STRING INTERNING
+// ============================================================================
+
+#if LOG_FORMAT_BINARY
+
+int findLogString(const LogStringTable& table, uint32_t hash) {
+  for (int i = 0; i < table.count; i++) {
+    if (table.hashes[i] == hash) return i;
+  }
+  return -1;
+}
+
+// Rebuilds the tables from access.str, so IDs continue where they left off
+void loadLogStrings() {
+  logUris.count = 0;
+  logUserAgents.count = 0;
+  
+  File stringsFile = openFile(ACCESS_LOG_STR_PATH, FILE_READ);
+  if (!stringsFile) {
+    return;
+  }
+  
+  BufferedReader reader(stringsFile);
+  int kind;
+  while ((kind = reader.read()) >= 0) {
+    uint32_t hash = 2166136261UL;
+    int c;
+    while ((c = reader.read()) > 0) {
+      uint8_t byte = c;
+      hash = hashBytes(&byte, 1, hash);
+    }
+    
+    LogStringTable& table = (kind == LOG_STRING_URI) ? logUris : logUserAgents;
+    if (table.count < LOG_STRING_TABLE_SIZE) {
+      table.hashes[table.count++] = hash;
+    }
+  }
+  stringsFile.close();
+}
+
+// ID of text in table, queueing it for access.str if it is new. A full
+// table starts a new log generation with empty tables.
+uint16_t internLogString(LogStringTable& table, char kind, const char* text) {
+  uint32_t hash = hashString(text);
+  int id = findLogString(table, hash);
+  if (id >= 0) {
+    return id;
+  }
+  
+  if (table.count == LOG_STRING_TABLE_SIZE) {
+    flushTrafficLog();
+    if (table.count == LOG_STRING_TABLE_SIZE) rotateTrafficLog();
   }
   
-  // Create timestamp (real time if available, otherwise relative uptime)
-  String timestamp;
+  size_t length = strlen(text);
+  if (logStringBufferLength + length + 2 > LOG_STRING_BUFFER_SIZE) {
+    flushTrafficLog();
+  }
+  logStringBuffer[logStringBufferLength++] = kind;
+  memcpy(logStringBuffer + logStringBufferLength, text, length + 1);
+  logStringBufferLength += length + 1;
+  
+  table.hashes[table.count] = hash;
+  return table.count++;
+}
+
+#endif // LOG_FORMAT_BINARY
+
+// Forgets the tracked size (and string IDs); call after /logs is edited
+void reloadTrafficLog() {
+  logFileSize = -1;
+  #if LOG_FORMAT_BINARY
+  loadLogStrings();
+  #endif
+}
+
+// ============================================================================
+// LOG FLUSHING
+// ============================================================================
+
+// Appends data to path and adds what was written to logFileSize
+void appendLogFile(const char* path, const char* data, size_t length) {
+  File logFile = openFile(path, FILE_WRITE);
+  if (!logFile) {
+    Serial.printf("ERROR: Could not open %s for writing\n", path);
+    return;
+  }
+  logFileSize += writeFile(logFile, data, length);
+  logFile.close();
+}
+
+// Appends everything buffered to the log, rotating it afterwards if full.
+// Failed writes are dropped rather than retried on every request.
+void flushTrafficLog() {
+  // The size is only read from the card once; appends keep it current
+  if (logFileSize < 0) {
+    #if LOG_FORMAT_BINARY
+    logFileSize = getFileSize(ACCESS_LOG_BIN_PATH) + getFileSize(ACCESS_LOG_STR_PATH);
+    #else
+    logFileSize = getFileSize(ACCESS_LOG_PATH);
+    #endif
+  }
+  
+  #if LOG_FORMAT_BINARY
+  // Strings first, so a record never refers to one that isn't on the card
+  if (logStringBufferLength > 0) {
+    appendLogFile(ACCESS_LOG_STR_PATH, logStringBuffer, logStringBufferLength);
+    logStringBufferLength = 0;
+  }
+  if (logBufferLength > 0) {
+    appendLogFile(ACCESS_LOG_BIN_PATH, logBuffer, logBufferLength);
+  }
+  #else
+  if (logBufferLength > 0) {
+    appendLogFile(ACCESS_LOG_PATH, logBuffer, logBufferLength);
+  }
+  #endif
+  logBufferLength = 0;
+  
+  if (logFileSize > MAX_LOG_SIZE) {
+    rotateTrafficLog();
+  }
+}
+
+// Call from loop(): writes once a full sector is waiting, or once traffic
+// has paused for LOG_FLUSH_IDLE_MS
+void serviceTrafficLog() {
+  if (logBufferLength >= SD_BLOCK_SIZE ||
+      (logBufferLength > 0 && millis() - logLastEntry > LOG_FLUSH_IDLE_MS)) {
+    flushTrafficLog();
+  }
+}
+
+// Called once at boot
+void initTrafficLog() {
+  reloadTrafficLog();
+}
+
+// ============================================================================
+// LOG ENTRIES
+// ============================================================================
+
+void logTraffic(int statusCode) {
+  // Real time if available, otherwise relative uptime
   time_t now = time(nullptr);
+  bool uptime = (now <= 1000000000);
+  uint32_t seconds = uptime ? millis() / 1000 : now;
   
-  if (now > 1000000000) {
-    // We have real time from NTP
-    struct tm timeinfo;
-    localtime_r(&now, &timeinfo);
-    char buffer[32];
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &timeinfo);
-    timestamp = String(buffer);
-  } else {
-    // Fall back to relative uptime
-    unsigned long uptime = millis() / 1000;
-    unsigned long days = uptime / 86400;
-    unsigned long hours = (uptime % 86400) / 3600;
-    unsigned long mins = (uptime % 3600) / 60;
-    unsigned long secs = uptime % 60;
-    timestamp = String(days) + "d " + String(hours) + "h " + String(mins) + "m " + String(secs) + "s";
-  }
-  
-  // Build log entry in Apache Combined Log Format
-  String logEntry = "[" + timestamp + "] ";
-  logEntry += clientIP + " - ";
-  logEntry += method + " " + uri + " - ";
-  logEntry += String(statusCode) + " - ";
-  logEntry += "\"" + userAgent + "\"\n";
+  IPAddress clientIP = server.client().remoteIP();
+  uint8_t ip[4] = { clientIP[0], clientIP[1], clientIP[2], clientIP[3] };
+  uint8_t method = server.method();
+  
+  // Handle missing, empty or overlong User-Agent
+  char userAgent[61] = "-";  // Standard log format for missing field
+  String userAgentHeader = server.header("User-Agent");
+  if (userAgentHeader.length() > 60) {
+    snprintf(userAgent, sizeof(userAgent), "%.57s...", userAgentHeader.c_str());
+  } else if (userAgentHeader.length() > 0) {
+    strcpy(userAgent, userAgentHeader.c_str());
+  }
+  String uri = server.uri();
   
+  #if ENABLE_TRAFFIC_STATS
+  recordTrafficStats(uri, statusCode, userAgent, seconds, uptime);
+  #endif
+  
+  #if LOG_TO_SERIAL || !LOG_FORMAT_BINARY
+  char entry[LOG_ENTRY_SIZE];
+  size_t length = formatLogEntry(entry, sizeof(entry), seconds, uptime, ip, method, uri.c_str(), statusCode, userAgent);
+  #endif
+  
+  #if LOG_TO_SERIAL
   // Print to serial for real-time monitoring
   Serial.print("ACCESS: ");
-  Serial.print(logEntry);
+  Serial.print(entry);
+  #endif
+  
+  #if LOG_FORMAT_BINARY
+  char uriKey[LOG_STRING_MAX_LENGTH];
+  snprintf(uriKey, sizeof(uriKey), "%s", uri.c_str());
   
-  // Check log file size and rotate if needed
-  File logFile = SD.open("/logs/access.log", FILE_READ);
-  if (logFile) {
-    size_t fileSize = logFile.size();
-    logFile.close();
+  AccessLogRecord record;
+  record.seconds = seconds;
+  memcpy(record.ip, ip, sizeof(ip));
+  
+  // Interning one string can flush and rotate the log, which empties both
+  // tables; an ID taken before that would point into the old access.str
+  uint32_t generation;
+  do {
+    generation = logStringGeneration;
+    record.uriId = internLogString(logUris, LOG_STRING_URI, uriKey);
+    record.userAgentId = internLogString(logUserAgents, LOG_STRING_USER_AGENT, userAgent);
+  } while (generation != logStringGeneration);
+  record.status = statusCode;
+  record.method = method;
+  record.flags = uptime ? LOG_FLAG_UPTIME : 0;
+  
+  const char* data = (const char*)&record;
+  size_t dataLength = sizeof(record);
+  #else
+  const char* data = entry;
+  size_t dataLength = length;
+  #endif
+  
+  // Only when loop() hasn't kept up does a request pay for the write
+  if (logBufferLength + dataLength > LOG_BUFFER_SIZE) {
+    flushTrafficLog();
+  }
+  memcpy(logBuffer + logBufferLength, data, dataLength);
+  logBufferLength += dataLength;
+  logLastEntry = millis();
+}
+
+#endif // ENABLE_TRAFFIC_LOG
+
+// ============================================================================
+// LOG READING
+// ============================================================================
+
+// Start of the count lines that end at offset before (a line start or the
+// end of the file), found by reading backwards one sector at a time
+size_t findLinesBefore(File& file, size_t before, int count) {
+  uint8_t block[SD_BLOCK_SIZE];
+  size_t position = before;
+  int found = 0;
+  
+  while (position > 0) {
+    // Keep reads sector-aligned
+    size_t n = position % SD_BLOCK_SIZE;
+    if (n == 0) n = SD_BLOCK_SIZE;
+    position -= n;
+    file.seek(position);
+    if (readFile(file, block, n) != (int)n) break;
     
-    if (fileSize > MAX_LOG_SIZE) {
-      // Rotate log: rename current to .old
-      SD.remove("/logs/access.old");
-      File current = SD.open("/logs/access.log", FILE_READ);
-      File old = SD.open("/logs/access.old", FILE_WRITE);
-      if (current && old) {
-        while (current.available()) {
-          old.write(current.read());
-        }
-        current.close();
-        old.close();
+    for (size_t i = n; i-- > 0;) {
+      // The newline ending the last line doesn't start a line
+      if (block[i] == '\n' && position + i + 1 < before && ++found == count) {
+        return position + i + 1;
       }
-      SD.remove("/logs/access.log");
-      Serial.println("LOG: Rotated access.log to access.old");
     }
   }
+  return 0;
+}
+
+// Offset just past the next count lines starting at from
+size_t findLinesAfter(File& file, size_t from, int count) {
+  file.seek(from);
+  BufferedReader reader(file);
+  size_t position = from;
+  int c;
   
-  // Append to log file
-  logFile = SD.open("/logs/access.log", FILE_WRITE);
-  if (logFile) {
-    logFile.print(logEntry);
-    logFile.close();
-  } else {
-    Serial.println("ERROR: Could not open log file for writing");
+  while (count > 0 && (c = reader.read()) >= 0) {
+    position++;
+    if (c == '\n') count--;
   }
+  return position;
 }
 
-#endif // ENABLE_TRAFFIC_LOG
+// Resolves the string IDs of binary records against one .str file. The
+// file is scanned once; each lookup is a seek and a short read.
+class LogStringReader {
+ public:
+  explicit LogStringReader(const String& path)
+      : uriOffsets(nullptr), userAgentOffsets(nullptr), uriCount(0), userAgentCount(0) {
+    file = openFile(path, FILE_READ);
+    if (!file) return;
+    
+    uriOffsets = new uint32_t[LOG_STRING_TABLE_SIZE];
+    userAgentOffsets = new uint32_t[LOG_STRING_TABLE_SIZE];
+    
+    BufferedReader reader(file);
+    uint32_t offset = 0;
+    int kind;
+    while ((kind = reader.read()) >= 0) {
+      if (kind == LOG_STRING_URI && uriCount < LOG_STRING_TABLE_SIZE) {
+        uriOffsets[uriCount++] = offset + 1;
+      } else if (kind == LOG_STRING_USER_AGENT && userAgentCount < LOG_STRING_TABLE_SIZE) {
+        userAgentOffsets[userAgentCount++] = offset + 1;
+      }
+      offset++;
+      while (reader.read() > 0) offset++;
+      offset++;
+    }
+  }
+  
+  ~LogStringReader() {
+    delete[] uriOffsets;
+    delete[] userAgentOffsets;
+    if (file) file.close();
+  }
+  
+  // Copies string id of kind into text; "?" if it isn't in the file
+  void get(char kind, uint16_t id, char* text, size_t size) {
+    bool uri = (kind == LOG_STRING_URI);
+    int count = uri ? uriCount : userAgentCount;
+    strcpy(text, "?");
+    if (id >= count || !file.seek((uri ? uriOffsets : userAgentOffsets)[id])) return;
+    
+    int length = readFile(file, text, size - 1);
+    text[max(length, 0)] = '\0';
+  }
+  
+ private:
+  File file;
+  uint32_t* uriOffsets;
+  uint32_t* userAgentOffsets;
+  int uriCount;
+  int userAgentCount;
+};
+
+// Renders a binary record in the text log format
+size_t formatLogRecord(const AccessLogRecord& record, LogStringReader& strings, char* entry, size_t size) {
+  char uri[LOG_STRING_MAX_LENGTH];
+  char userAgent[LOG_STRING_MAX_LENGTH];
+  strings.get(LOG_STRING_URI, record.uriId, uri, sizeof(uri));
+  strings.get(LOG_STRING_USER_AGENT, record.userAgentId, userAgent, sizeof(userAgent));
+  
+  return formatLogEntry(entry, size, record.seconds, record.flags & LOG_FLAG_UPTIME, record.ip,
+                        record.method, uri, record.status, userAgent);
+}
 
 #endif // LOGGER_H
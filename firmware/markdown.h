@@ -0,0 +1,383 @@
+/*
+ * markdown.h - Markdown to HTML Rendering
+ *
+ * Converts a Markdown post to HTML line by line as it is read from the SD
+ * card. Memory use is bounded by one line buffer however long the post is;
+ * lines longer than MARKDOWN_LINE_SIZE are rendered in pieces, cut at spaces
+ * so that links, escapes and emphasis aren't split.
+ */
+
+#ifndef MARKDOWN_H
+#define MARKDOWN_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "config.h"
+#include "renderer.h"
+#include "storage.h"
+
+enum MarkdownBlock : uint8_t {
+  BLOCK_NONE,
+  BLOCK_PARAGRAPH,
+  BLOCK_HEADING,
+  BLOCK_UNORDERED_LIST,
+  BLOCK_ORDERED_LIST,
+  BLOCK_QUOTE,
+  BLOCK_CODE
+};
+
+struct MarkdownState {
+  MarkdownBlock block;
+  uint8_t headingLevel;
+  int codeLines;       // Lines written so far in the current code block
+  bool strong;
+  bool emphasis;
+  bool code;           // Inside an inline `code` span
+};
+
+// ============================================================================
+// INLINE ELEMENTS
+// ============================================================================
+
+void writeInline(MarkdownState& md, const char* text, size_t length);
+
+void closeInline(MarkdownState& md) {
+  if (md.code) writeOutput("</code>");
+  if (md.emphasis) writeOutput("</em>");
+  if (md.strong) writeOutput("</strong>");
+  md.code = md.emphasis = md.strong = false;
+}
+
+// Opens or closes <strong>/<em> if the delimiter run at text[i] is in a
+// valid position: openers precede a non-space, closers follow one, and
+// underscores inside words (snake_case) are left alone
+bool toggleEmphasis(bool& open, const char* tag, const char* text, size_t i, size_t width, size_t length) {
+  char before = (i > 0) ? text[i - 1] : ' ';
+  char after = (i + width < length) ? text[i + width] : ' ';
+  bool underscore = (text[i] == '_');
+  
+  if (!open && after != ' ' && !(underscore && isalnum(before))) {
+    writeOutput('<');
+  } else if (open && before != ' ' && !(underscore && isalnum(after))) {
+    writeOutput("</");
+  } else {
+    return false;
+  }
+  
+  writeOutput(tag);
+  writeOutput('>');
+  open = !open;
+  return true;
+}
+
+// Renders [text](url) or, for images, [alt](url) starting at text[0] == '['.
+// Returns the number of bytes consumed, or 0 if this isn't a link.
+size_t writeLink(MarkdownState& md, const char* text, size_t length, bool image) {
+  const char* close = (const char*)memchr(text, ']', length);
+  if (!close || close + 1 >= text + length || close[1] != '(') return 0;
+  
+  const char* url = close + 2;
+  const char* end = (const char*)memchr(url, ')', text + length - url);
+  if (!end) return 0;
+  
+  // Drop an optional "title" after the URL
+  const char* urlEnd = url;
+  while (urlEnd < end && *urlEnd != ' ') urlEnd++;
+  
+  if (image) {
+    writeOutput("<img src=\"");
+    writeEscaped(url, urlEnd - url);
+    writeOutput("\" alt=\"");
+    writeEscaped(text + 1, close - text - 1);
+    writeOutput("\" loading=\"lazy\">");
+  } else {
+    writeOutput("<a href=\"");
+    writeEscaped(url, urlEnd - url);
+    writeOutput("\">");
+    writeInline(md, text + 1, close - text - 1);
+    writeOutput("</a>");
+  }
+  return end - text + 1;
+}
+
+void writeInline(MarkdownState& md, const char* text, size_t length) {
+  size_t i = 0;
+  
+  while (i < length) {
+    char c = text[i];
+    char next = (i + 1 < length) ? text[i + 1] : '\0';
+    
+    // Code spans are literal up to the closing backtick
+    if (md.code) {
+      if (c == '`') {
+        writeOutput("</code>");
+        md.code = false;
+      } else {
+        writeEscaped(&c, 1);
+      }
+      i++;
+      continue;
+    }
+    
+    if (c == '\\' && next && strchr("\\`*_[]()#+-.!>", next)) {
+      writeEscaped(&next, 1);
+      i += 2;
+    } else if (c == '`') {
+      writeOutput("<code>");
+      md.code = true;
+      i++;
+    } else if ((c == '*' || c == '_') && next == c && toggleEmphasis(md.strong, "strong", text, i, 2, length)) {
+      i += 2;
+    } else if ((c == '*' || c == '_') && toggleEmphasis(md.emphasis, "em", text, i, 1, length)) {
+      i++;
+    } else if (c == '!' && next == '[') {
+      size_t used = writeLink(md, text + i + 1, length - i - 1, true);
+      if (used == 0) writeOutput(c);
+      i += used + 1;
+    } else if (c == '[') {
+      size_t used = writeLink(md, text + i, length - i, false);
+      if (used == 0) writeOutput(c);
+      i += (used > 0) ? used : 1;
+    } else if (c == '<' && !(isalpha(next) || next == '/' || next == '!')) {
+      // Inline HTML passes through; a lone '<' is text
+      writeOutput("&lt;", 4);
+      i++;
+    } else {
+      writeOutput(c);
+      i++;
+    }
+  }
+}
+
+// ============================================================================
+// BLOCK ELEMENTS
+// ============================================================================
+
+void closeBlock(MarkdownState& md) {
+  closeInline(md);
+  
+  switch (md.block) {
+    case BLOCK_PARAGRAPH:      writeOutput("</p>\n"); break;
+    case BLOCK_UNORDERED_LIST: writeOutput("</li>\n</ul>\n"); break;
+    case BLOCK_ORDERED_LIST:   writeOutput("</li>\n</ol>\n"); break;
+    case BLOCK_QUOTE:          writeOutput("</p></blockquote>\n"); break;
+    case BLOCK_CODE:           writeOutput("</code></pre>\n"); break;
+    case BLOCK_HEADING:
+      writeOutput("</h");
+      writeOutput((char)('0' + md.headingLevel));
+      writeOutput(">\n");
+      break;
+    default: break;
+  }
+  md.block = BLOCK_NONE;
+}
+
+// Starts a list item, opening the list first unless one of the same kind is open
+void startListItem(MarkdownState& md, MarkdownBlock list) {
+  if (md.block == list) {
+    closeInline(md);
+    writeOutput("</li>\n");
+  } else {
+    closeBlock(md);
+    writeOutput(list == BLOCK_ORDERED_LIST ? "<ol>\n" : "<ul>\n");
+    md.block = list;
+  }
+  writeOutput("<li>");
+}
+
+// A line of three or more -, * or _ (spaces allowed) is a horizontal rule
+bool isHorizontalRule(const char* line) {
+  char marker = *line;
+  if (marker != '-' && marker != '*' && marker != '_') return false;
+  
+  int count = 0;
+  for (; *line; line++) {
+    if (*line == marker) count++;
+    else if (*line != ' ') return false;
+  }
+  return count >= 3;
+}
+
+// Handles a piece of text that starts a new line; complete if it ends it too
+void renderMarkdownLine(MarkdownState& md, char* line, size_t length, bool complete) {
+  // Inside a fenced code block everything but the closing fence is literal
+  if (md.block == BLOCK_CODE) {
+    if (strncmp(line, "```", 3) == 0) {
+      closeBlock(md);
+    } else {
+      if (md.codeLines++ > 0) writeOutput('\n');
+      writeEscaped(line, length);
+    }
+    return;
+  }
+  
+  // Up to three leading spaces don't change the meaning of a line
+  char* text = line;
+  while (*text == ' ' && text - line < 3) text++;
+  size_t textLength = length - (text - line);
+  
+  if (*text == '\0' || strspn(text, " \t") == textLength) {
+    closeBlock(md);
+    return;
+  }
+  
+  if (strncmp(text, "```", 3) == 0) {
+    closeBlock(md);
+    writeOutput("<pre><code");
+    char* language = text + 3;
+    while (*language == ' ') language++;
+    if (*language) {
+      writeOutput(" class=\"language-");
+      writeEscaped(language, strlen(language));
+      writeOutput('"');
+    }
+    writeOutput('>');
+    md.block = BLOCK_CODE;
+    md.codeLines = 0;
+    return;
+  }
+  
+  if (*text == '#') {
+    int level = strspn(text, "#");
+    if (level <= 6 && (text[level] == ' ' || text[level] == '\0')) {
+      closeBlock(md);
+      
+      // Strip the optional closing #s
+      char* end = text + textLength;
+      while (complete && end > text + level && (end[-1] == '#' || end[-1] == ' ')) end--;
+      char* content = text + level;
+      while (content < end && *content == ' ') content++;
+      
+      writeOutput("<h");
+      writeOutput((char)('0' + level));
+      writeOutput('>');
+      md.block = BLOCK_HEADING;
+      md.headingLevel = level;
+      writeInline(md, content, end - content);
+      return;
+    }
+  }
+  
+  if (isHorizontalRule(text)) {
+    closeBlock(md);
+    writeOutput("<hr>\n");
+    return;
+  }
+  
+  if ((*text == '-' || *text == '*' || *text == '+') && text[1] == ' ') {
+    startListItem(md, BLOCK_UNORDERED_LIST);
+    writeInline(md, text + 2, textLength - 2);
+    return;
+  }
+  
+  size_t digits = strspn(text, "0123456789");
+  if (digits > 0 && (text[digits] == '.' || text[digits] == ')') && text[digits + 1] == ' ') {
+    startListItem(md, BLOCK_ORDERED_LIST);
+    writeInline(md, text + digits + 2, textLength - digits - 2);
+    return;
+  }
+  
+  if (*text == '>') {
+    char* content = text + 1;
+    if (*content == ' ') content++;
+    if (md.block == BLOCK_QUOTE) {
+      writeOutput('\n');
+    } else {
+      closeBlock(md);
+      writeOutput("<blockquote><p>");
+      md.block = BLOCK_QUOTE;
+    }
+    writeInline(md, content, textLength - (content - text));
+    return;
+  }
+  
+  // Plain text continues the open paragraph, list item or quote
+  if (md.block == BLOCK_PARAGRAPH || md.block == BLOCK_UNORDERED_LIST ||
+      md.block == BLOCK_ORDERED_LIST || md.block == BLOCK_QUOTE) {
+    writeOutput('\n');
+  } else {
+    closeBlock(md);
+    writeOutput("<p>");
+    md.block = BLOCK_PARAGRAPH;
+  }
+  writeInline(md, text, textLength);
+}
+
+// ============================================================================
+// POST RENDERING
+// ============================================================================
+
+// Where to end a piece of a line that continues in the next one: just after
+// the last space that follows every complete link and precedes any link
+// whose "](url)" hasn't been read yet. Whatever comes after is rendered with
+// the next piece, so links, escapes and emphasis always see their neighbours.
+// Returns length if the piece has to be rendered as it is.
+size_t pieceEnd(const char* text, size_t length) {
+  size_t settled = 0;      // End of the last complete link
+  size_t pending = length; // Start of the first unfinished one
+  
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] != '[') continue;
+    
+    const char* close = (const char*)memchr(text + i, ']', length - i);
+    const char* end = nullptr;
+    if (close && close + 1 < text + length && close[1] == '(') {
+      end = (const char*)memchr(close + 2, ')', text + length - close - 2);
+    }
+    if (!close || close + 1 == text + length || (close[1] == '(' && !end)) {
+      pending = i;
+      break;
+    }
+    if (end) settled = max(settled, (size_t)(end - text + 1));
+  }
+  
+  size_t space = pending;
+  while (space > settled && text[space] != ' ') space--;
+  
+  // A line's first piece keeps its block marker and some text, and at most
+  // three quarters of the buffer is carried so that each read makes progress
+  if (text[space] != ' ' || space <= strspn(text, " ") ||
+      length - space - 1 > MARKDOWN_LINE_SIZE * 3 / 4) {
+    return length;
+  }
+  return space + 1;
+}
+
+void renderMarkdown(File& file) {
+  MarkdownState md = {};
+  BufferedReader reader(file);
+  char line[MARKDOWN_LINE_SIZE];
+  size_t carried = 0;  // Bytes of the line kept back from the last piece
+  size_t length;
+  bool complete;
+  bool lineStart = true;
+  
+  while (reader.readLinePart(line + carried, sizeof(line) - carried, &length, &complete)) {
+    length += carried;
+    size_t end = (complete || md.block == BLOCK_CODE) ? length : pieceEnd(line, length);
+    char next = line[end];
+    line[end] = '\0';
+    
+    if (lineStart) {
+      renderMarkdownLine(md, line, end, complete && end == length);
+    } else if (md.block == BLOCK_CODE) {
+      writeEscaped(line, end);
+    } else {
+      writeInline(md, line, end);
+    }
+    
+    line[end] = next;
+    carried = length - end;
+    memmove(line, line + end, carried);
+    
+    // Headings end with their line
+    if (complete && md.block == BLOCK_HEADING) {
+      closeBlock(md);
+    }
+    lineStart = complete;
+  }
+  
+  closeBlock(md);
+}
+
+#endif // MARKDOWN_H
@@ -0,0 +1,177 @@
+/*
+ * metrics.h - Request Timing and Prometheus Metrics
+ *
+ * Every handler registered in setupRoutes() is wrapped with timed(), which
+ * records its run time in a per-route latency histogram. Together with the
+ * SD card counters from storage.h and the bytes counted by renderer.h these
+ * are exported in the Prometheus text format at /admin/metrics.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include "config.h"
+#include "storage.h"
+#include "renderer.h"
+#include "stats.h"
+
+#if ENABLE_METRICS
+
+// Histogram upper bounds, in microseconds and as Prometheus "le" labels
+const uint32_t latencyBucketMicros[] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000 };
+const char* const latencyBucketLabels[] = { "0.001", "0.002", "0.005", "0.01", "0.02", "0.05", "0.1", "0.2", "0.5", "1", "2" };
+const int LATENCY_BUCKET_COUNT = sizeof(latencyBucketMicros) / sizeof(latencyBucketMicros[0]);
+
+struct RouteTiming {
+  const char* route;
+  uint32_t buckets[LATENCY_BUCKET_COUNT + 1];  // Per bucket, not cumulative; the last is +Inf
+  uint64_t totalMicros;
+  uint32_t count;
+};
+
+// Filled in as routes are registered, so its size is fixed after setup()
+RouteTiming routeTimings[METRICS_MAX_ROUTES];
+int routeTimingCount = 0;
+
+// ============================================================================
+// TIMING
+// ============================================================================
+
+// Slot for route, shared by every handler registered under that name;
+// -1 once the table is full
+int routeTimingSlot(const char* route) {
+  for (int i = 0; i < routeTimingCount; i++) {
+    if (strcmp(routeTimings[i].route, route) == 0) return i;
+  }
+  if (routeTimingCount == METRICS_MAX_ROUTES) {
+    Serial.printf("WARNING: No timing slot left for %s\n", route);
+    return -1;
+  }
+  
+  RouteTiming& timing = routeTimings[routeTimingCount];
+  memset(&timing, 0, sizeof(timing));
+  timing.route = route;
+  return routeTimingCount++;
+}
+
+void recordLatency(int slot, uint32_t elapsedMicros) {
+  RouteTiming& timing = routeTimings[slot];
+  int bucket = 0;
+  while (bucket < LATENCY_BUCKET_COUNT && elapsedMicros > latencyBucketMicros[bucket]) {
+    bucket++;
+  }
+  timing.buckets[bucket]++;
+  timing.totalMicros += elapsedMicros;
+  timing.count++;
+}
+
+// Wraps a handler so its run time is recorded under route, which must be a
+// string literal. Only the handler is timed, not reading the request.
+ESP8266WebServer::THandlerFunction timed(const char* route, ESP8266WebServer::THandlerFunction handler) {
+  int slot = routeTimingSlot(route);
+  if (slot < 0) return handler;
+  
+  return [slot, handler]() {
+    uint32_t start = micros();
+    handler();
+    recordLatency(slot, micros() - start);
+  };
+}
+
+// ============================================================================
+// PROMETHEUS EXPORT
+// ============================================================================
+
+void writeMetricValue(uint64_t value) {
+  char digits[21];
+  int start = sizeof(digits) - 1;
+  digits[start] = '\0';
+  do {
+    digits[--start] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  writeOutput(digits + start);
+}
+
+void writeMetricHeader(const char* name, const char* type, const char* help) {
+  writeOutput("# HELP ");
+  writeOutput(name);
+  writeOutput(" ");
+  writeOutput(help);
+  writeOutput("\n# TYPE ");
+  writeOutput(name);
+  writeOutput(" ");
+  writeOutput(type);
+  writeOutput("\n");
+}
+
+// A metric without labels
+void writeMetric(const char* name, const char* type, const char* help, uint64_t value) {
+  writeMetricHeader(name, type, help);
+  writeOutput(name);
+  writeOutput(" ");
+  writeMetricValue(value);
+  writeOutput("\n");
+}
+
+void writeLatencyHistograms() {
+  writeMetricHeader("blog_handler_duration_seconds", "histogram", "Time spent in each route handler");
+  
+  for (int i = 0; i < routeTimingCount; i++) {
+    const RouteTiming& timing = routeTimings[i];
+    String labels = String("{route=\"") + timing.route + "\"";
+    
+    uint64_t cumulative = 0;
+    for (int bucket = 0; bucket <= LATENCY_BUCKET_COUNT; bucket++) {
+      cumulative += timing.buckets[bucket];
+      writeOutput("blog_handler_duration_seconds_bucket" + labels + ",le=\"");
+      writeOutput(bucket < LATENCY_BUCKET_COUNT ? latencyBucketLabels[bucket] : "+Inf");
+      writeOutput("\"} ");
+      writeMetricValue(cumulative);
+      writeOutput("\n");
+    }
+    
+    char seconds[24];
+    snprintf(seconds, sizeof(seconds), "%lu.%06lu", (unsigned long)(timing.totalMicros / 1000000),
+             (unsigned long)(timing.totalMicros % 1000000));
+    writeOutput("blog_handler_duration_seconds_sum" + labels + "} " + seconds + "\n");
+    writeOutput("blog_handler_duration_seconds_count" + labels + "} ");
+    writeMetricValue(timing.count);
+    writeOutput("\n");
+  }
+}
+
+// Streams every metric; the caller has begun a chunked response
+void writeMetrics() {
+  writeLatencyHistograms();
+  
+  writeMetric("blog_sd_opens_total", "counter", "Files and directories opened on the SD card", sdCounters.opens);
+  writeMetric("blog_sd_read_bytes_total", "counter", "Bytes read from the SD card", sdCounters.bytesRead);
+  writeMetric("blog_sd_written_bytes_total", "counter", "Bytes written to the SD card", sdCounters.bytesWritten);
+  writeMetric("blog_response_bytes_total", "counter", "Response body bytes sent", responseBytesSent);
+  
+  #if ENABLE_TRAFFIC_STATS
+  writeMetricHeader("blog_responses_total", "counter", "Logged responses by status code");
+  for (int i = 0; i < STATS_STATUS_SLOTS && trafficStats.statuses[i].status != 0; i++) {
+    writeOutput("blog_responses_total{status=\"" + String(trafficStats.statuses[i].status) + "\"} ");
+    writeMetricValue(trafficStats.statuses[i].count);
+    writeOutput("\n");
+  }
+  #endif
+  
+  writeMetric("blog_uptime_seconds", "gauge", "Seconds since boot", millis() / 1000);
+  writeMetric("blog_free_heap_bytes", "gauge", "Free heap", ESP.getFreeHeap());
+}
+
+#else
+
+// Without metrics, handlers are registered as they are
+ESP8266WebServer::THandlerFunction timed(const char* route, ESP8266WebServer::THandlerFunction handler) {
+  return handler;
+}
+
+#endif // ENABLE_METRICS
+
+#endif // METRICS_H
@@ -0,0 +1,225 @@
+/*
+ * pagecache.h - Rendered Page Cache
+ *
+ * Keeps fully rendered post pages in /cache/pages so a repeat view is a
+ * single open plus streamFile, with no Markdown or template work. Listing
+ * pages (home, /page and /archive) are cached too, in RAM when small.
+ */
+
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "config.h"
+#include "renderer.h"
+
+#define PAGE_CACHE_DIR "/cache/pages"
+
+// One file per route, named after the route's path hash
+String pageCachePath(const PostMapping& mapping) {
+  char name[32];
+  snprintf(name, sizeof(name), PAGE_CACHE_DIR "/%08lx.htm", (unsigned long)mapping.pathHash);
+  return String(name);
+}
+
+// ============================================================================
+// CACHE FILLING
+// ============================================================================
+
+// Starts copying everything the renderer sends into a temporary cache file
+void beginPageCapture(const String& cachePath) {
+  String tempPath = cachePath + ".tmp";
+  SD.mkdir(PAGE_CACHE_DIR);
+  SD.remove(tempPath);
+  outputCapture = openFile(tempPath, FILE_WRITE);
+  captureFailed = false;
+}
+
+// Stops capturing and publishes the cache file, unless a write fell short;
+// call after endChunkedPage()
+bool endPageCapture(const String& cachePath) {
+  if (!outputCapture) return false;
+  outputCapture.close();
+  
+  String tempPath = cachePath + ".tmp";
+  if (captureFailed || !SD.rename(tempPath, cachePath)) {
+    SD.remove(tempPath);
+    return false;
+  }
+  return true;
+}
+
+// ============================================================================
+// INVALIDATION
+// ============================================================================
+
+// Drops every cached page; used when templates or routes change
+void clearPageCache() {
+  File dir = openFile(PAGE_CACHE_DIR);
+  if (!dir || !dir.isDirectory()) {
+    return;
+  }
+  
+  int removed = 0;
+  while (true) {
+    File entry = dir.openNextFile();
+    if (!entry) break;
+    
+    String name = String(entry.name());
+    int lastSlash = name.lastIndexOf('/');
+    if (lastSlash != -1) {
+      name = name.substring(lastSlash + 1);
+    }
+    entry.close();
+    
+    if (SD.remove(String(PAGE_CACHE_DIR "/") + name)) {
+      removed++;
+    }
+    yield();
+  }
+  dir.close();
+  
+  Serial.printf("Page cache cleared (%d files)\n", removed);
+}
+
+// Drops the cached pages of every route that shows fileName
+void invalidatePostPages(const String& fileName) {
+  for (int i = 0; i < postMappingsCount; i++) {
+    if (fileName == postMappings[i].fileName()) {
+      SD.remove(pageCachePath(postMappings[i]));
+    }
+  }
+}
+
+// ============================================================================
+// LISTING PAGES
+// ============================================================================
+
+#define LISTING_ARCHIVE -1  // Page number standing for /archive
+
+#if ENABLE_LISTING_CACHE
+
+// A rendered listing page, valid only for the version its ETag was made
+// from; any template, route or post change gives the page a new version
+struct ListingCacheEntry {
+  bool valid;
+  int page;          // Page number, or LISTING_ARCHIVE
+  uint32_t version;
+  char* html;        // The page in RAM, or nullptr if it's in listingCachePath()
+  size_t length;
+  uint32_t lastUsed;
+};
+
+ListingCacheEntry listingCache[LISTING_CACHE_ENTRIES];
+uint32_t listingCacheClock = 0;
+
+String listingCachePath(int page) {
+  if (page == LISTING_ARCHIVE) return PAGE_CACHE_DIR "/archive.htm";
+  char name[32];
+  snprintf(name, sizeof(name), PAGE_CACHE_DIR "/page%d.htm", page);
+  return String(name);
+}
+
+void dropListingPage(ListingCacheEntry& entry) {
+  delete[] entry.html;
+  entry.html = nullptr;
+  entry.valid = false;
+}
+
+// The entry for page, or the one to replace with it
+ListingCacheEntry& listingCacheSlot(int page) {
+  ListingCacheEntry* slot = &listingCache[0];
+  for (ListingCacheEntry& entry : listingCache) {
+    if (entry.valid && entry.page == page) return entry;
+    if (slot->valid && (!entry.valid || entry.lastUsed < slot->lastUsed)) slot = &entry;
+  }
+  return *slot;
+}
+
+// Called from loop(): frees pages held in RAM once free heap falls below
+// the watermark. Their next view renders them again.
+void trimListingCache() {
+  for (ListingCacheEntry& entry : listingCache) {
+    if (ESP.getFreeHeap() >= LISTING_CACHE_MIN_FREE_HEAP) break;
+    if (entry.html) dropListingPage(entry);
+  }
+}
+
+#endif // ENABLE_LISTING_CACHE
+
+// Sends page if a copy of this version is cached. Returns false, having
+// sent nothing, if it has to be rendered.
+bool serveCachedListingPage(int page, uint32_t version) {
+  #if ENABLE_LISTING_CACHE
+  ListingCacheEntry& entry = listingCacheSlot(page);
+  if (!entry.valid || entry.page != page) return false;
+  if (entry.version != version) {
+    dropListingPage(entry);
+    return false;
+  }
+  entry.lastUsed = ++listingCacheClock;
+  
+  if (entry.html) {
+    sendBufferResponse(200, "text/html", entry.html, entry.length);
+    return true;
+  }
+  
+  File file = openFile(listingCachePath(page), FILE_READ);
+  if (!file) {
+    dropListingPage(entry);
+    return false;
+  }
+  streamFileResponse(file, "text/html");
+  file.close();
+  return true;
+  #else
+  return false;
+  #endif
+}
+
+// Starts copying the page being rendered into RAM. A page that outgrows
+// LISTING_CACHE_RAM_SIZE, or any page while heap is short, goes to SD.
+void beginListingCapture(int page) {
+  #if ENABLE_LISTING_CACHE
+  String cachePath = listingCachePath(page);
+  SD.remove(cachePath);
+  
+  if (ESP.getFreeHeap() < LISTING_CACHE_MIN_FREE_HEAP + LISTING_CACHE_RAM_SIZE) {
+    beginPageCapture(cachePath);
+    return;
+  }
+  SD.mkdir(PAGE_CACHE_DIR);
+  captureBuffer = new char[LISTING_CACHE_RAM_SIZE];
+  captureLength = 0;
+  captureCapacity = LISTING_CACHE_RAM_SIZE;
+  captureSpillPath = cachePath + ".tmp";
+  captureFailed = false;
+  #endif
+}
+
+// Stops capturing and caches the page; call after endChunkedPage()
+void endListingCapture(int page, uint32_t version) {
+  #if ENABLE_LISTING_CACHE
+  ListingCacheEntry& entry = listingCacheSlot(page);
+  dropListingPage(entry);
+  
+  if (captureBuffer) {
+    // Keep only as much RAM as the page needs
+    entry.html = new char[max(captureLength, (size_t)1)];
+    memcpy(entry.html, captureBuffer, captureLength);
+    entry.length = captureLength;
+    delete[] captureBuffer;
+    captureBuffer = nullptr;
+  } else if (!endPageCapture(listingCachePath(page))) {
+    return;
+  }
+  
+  entry.valid = true;
+  entry.page = page;
+  entry.version = version;
+  entry.lastUsed = ++listingCacheClock;
+  #endif
+}
+
+#endif // PAGECACHE_H
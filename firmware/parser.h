@@ -10,82 +10,249 @@
 #include <Arduino.h>
 #include <SD.h>
 #include "config.h"
+#include "storage.h"
+
+// ============================================================================
+// STRING HASHING
+// ============================================================================
+
+// 32-bit FNV-1a, used to fingerprint paths and file names
+uint32_t hashString(const char* text) {
+  uint32_t hash = 2166136261UL;
+  while (*text) {
+    hash ^= (uint8_t)*text++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+// FNV-1a over raw bytes; pass a previous result as hash to continue it
+uint32_t hashBytes(const void* data, size_t length, uint32_t hash = 2166136261UL) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
 
 // ============================================================================
 // TEMPLATE LOADING
 // ============================================================================
 
 String loadTemplate(String templateName) {
-  File templateFile = SD.open("/templates/" + templateName, FILE_READ);
+  File templateFile = openFile("/templates/" + templateName, FILE_READ);
   if (!templateFile) {
     Serial.println("Template not found: " + templateName);
     return "";
   }
   
-  String content = "";
-  while (templateFile.available()) {
-    content += (char)templateFile.read();
-  }
+  String content = readFileToString(templateFile);
   templateFile.close();
   
   return content;
 }
 
 String loadPartial(String partialName) {
-  File partialFile = SD.open("/templates/" + partialName, FILE_READ);
+  File partialFile = openFile("/templates/" + partialName, FILE_READ);
   if (!partialFile) {
     return "";
   }
   
-  String content = "";
-  while (partialFile.available()) {
-    content += (char)partialFile.read();
-  }
+  String content = readFileToString(partialFile);
   partialFile.close();
   
   return content;
 }
 
 // ============================================================================
-// TEMPLATE VARIABLE REPLACEMENT
+// TEMPLATE COMPILATION
 // ============================================================================
 
-String replaceTemplateVars(String html, String title, String content) {
-  html.replace("{{TITLE}}", title);
-  html.replace("{{CONTENT}}", content);
-  html.replace("{{HEADER}}", loadPartial("header.html"));
-  html.replace("{{FOOTER}}", loadPartial("footer.html"));
+// Placeholders the page handlers fill in at request time
+enum TemplateVar : uint8_t {
+  VAR_NONE,
+  VAR_TITLE,
+  VAR_POST_TITLE,
+  VAR_CONTENT,
+  VAR_POSTS,
+  VAR_PAGINATION,
+  VAR_POST_COUNT,
+  VAR_POST_LIST,
+  VAR_QUERY,
+  VAR_RESULTS,
+  VAR_COUNT
+};
+
+const char* const templateVarNames[VAR_COUNT] = {
+  "", "TITLE", "POST_TITLE", "CONTENT", "POSTS", "PAGINATION", "POST_COUNT", "POST_LIST", "QUERY", "RESULTS"
+};
+
+// Public page templates kept compiled in RAM
+enum PageTemplate {
+  TEMPLATE_HOME,
+  TEMPLATE_ARCHIVE,
+  TEMPLATE_POST,
+  TEMPLATE_404,
+  TEMPLATE_SEARCH,
+  TEMPLATE_COUNT
+};
+
+const char* const pageTemplateFiles[TEMPLATE_COUNT] = {
+  "home.html", "archive.html", "post.html", "404.html", "search.html"
+};
+
+// A literal byte range followed by a placeholder (VAR_NONE for the last one)
+struct TemplateSegment {
+  uint16_t offset;
+  uint16_t length;
+  TemplateVar var;
+};
+
+struct CompiledTemplate {
+  char* text;                  // All literal text, placeholders removed
+  TemplateSegment* segments;
+  int segmentCount;
+};
+
+CompiledTemplate compiledTemplates[TEMPLATE_COUNT];
+
+// Identify the compiled templates for HTTP validators (see httpcache.h)
+uint32_t templateVersion = 0;     // Hash of all compiled template content
+time_t templatesLastWrite = 0;    // Newest template or partial on SD
+
+TemplateVar findTemplateVar(const String& name) {
+  for (int i = 1; i < VAR_COUNT; i++) {
+    if (name == templateVarNames[i]) {
+      return (TemplateVar)i;
+    }
+  }
+  return VAR_NONE;
+}
+
+void freeCompiledTemplate(CompiledTemplate& tpl) {
+  delete[] tpl.text;
+  delete[] tpl.segments;
+  tpl.text = nullptr;
+  tpl.segments = nullptr;
+  tpl.segmentCount = 0;
+}
+
+// Splits a template into literal ranges and placeholder IDs. Partials and
+// {{YEAR}} never change between requests, so they are inlined here.
+bool compileTemplate(String html, const String& header, const String& footer, CompiledTemplate& tpl) {
+  html.replace("{{HEADER}}", header);
+  html.replace("{{FOOTER}}", footer);
   html.replace("{{YEAR}}", String(2026));
-  return html;
+  
+  if (html.length() == 0 || html.length() > 0xFFFF) {
+    return false;
+  }
+  
+  // Count placeholders to size the segment table
+  int segmentCount = 1;
+  int pos = 0;
+  while ((pos = html.indexOf("{{", pos)) >= 0) {
+    int end = html.indexOf("}}", pos + 2);
+    if (end < 0) break;
+    if (findTemplateVar(html.substring(pos + 2, end)) != VAR_NONE) {
+      segmentCount++;
+    }
+    pos = end + 2;
+  }
+  
+  tpl.text = new char[html.length()];
+  tpl.segments = new TemplateSegment[segmentCount];
+  tpl.segmentCount = 0;
+  
+  const char* source = html.c_str();
+  uint16_t textLength = 0;
+  uint16_t segmentStart = 0;
+  int literalStart = 0;
+  pos = 0;
+  
+  while ((pos = html.indexOf("{{", pos)) >= 0) {
+    int end = html.indexOf("}}", pos + 2);
+    if (end < 0) break;
+    
+    // Unknown placeholders stay in the literal text
+    TemplateVar var = findTemplateVar(html.substring(pos + 2, end));
+    if (var != VAR_NONE) {
+      memcpy(tpl.text + textLength, source + literalStart, pos - literalStart);
+      textLength += pos - literalStart;
+      tpl.segments[tpl.segmentCount++] = { segmentStart, (uint16_t)(textLength - segmentStart), var };
+      segmentStart = textLength;
+      literalStart = end + 2;
+    }
+    pos = end + 2;
+  }
+  
+  memcpy(tpl.text + textLength, source + literalStart, html.length() - literalStart);
+  textLength += html.length() - literalStart;
+  tpl.segments[tpl.segmentCount++] = { segmentStart, (uint16_t)(textLength - segmentStart), VAR_NONE };
+  
+  return true;
+}
+
+void loadTemplateCache() {
+  Serial.println("Compiling templates...");
+  
+  String header = loadPartial("header.html");
+  String footer = loadPartial("footer.html");
+  templatesLastWrite = max(getFileLastWrite("/templates/header.html"), getFileLastWrite("/templates/footer.html"));
+  templateVersion = 2166136261UL;
+  
+  for (int i = 0; i < TEMPLATE_COUNT; i++) {
+    CompiledTemplate& tpl = compiledTemplates[i];
+    freeCompiledTemplate(tpl);
+    #if !ENABLE_SEARCH
+    if (i == TEMPLATE_SEARCH) continue;
+    #endif
+    if (!compileTemplate(loadTemplate(pageTemplateFiles[i]), header, footer, tpl)) {
+      Serial.println("Failed to compile template: " + String(pageTemplateFiles[i]));
+      continue;
+    }
+    
+    const TemplateSegment& last = tpl.segments[tpl.segmentCount - 1];
+    templateVersion = hashBytes(tpl.text, last.offset + last.length, templateVersion);
+    templateVersion = hashBytes(tpl.segments, tpl.segmentCount * sizeof(TemplateSegment), templateVersion);
+    templatesLastWrite = max(templatesLastWrite, getFileLastWrite(String("/templates/") + pageTemplateFiles[i]));
+  }
+  
+  Serial.println("Templates compiled");
 }
 
 // ============================================================================
 // POST PREVIEW EXTRACTION
 // ============================================================================
 
-String getPostPreview(String filename) {
-  File postFile = SD.open("/posts/" + filename, FILE_READ);
-  if (!postFile) return "Preview not available.";
-  
+// Reads the first paragraph of an already open post
+String extractPostPreview(File& postFile) {
   String preview = "";
   bool foundFirstParagraph = false;
   
-  while (postFile.available()) {
-    String line = postFile.readStringUntil('\n');
-    line.trim();
+  BufferedReader reader(postFile);
+  char line[256];
+  size_t lineLength;
+  
+  while (reader.readLine(line, sizeof(line), &lineLength)) {
+    // Trim in place
+    char* start = line;
+    while (*start == ' ' || *start == '\t') start++;
+    char* end = line + lineLength;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    *end = '\0';
     
     // Skip empty lines, headers, and images
-    if (line.length() == 0 || line.startsWith("#") || line.startsWith("![")) {
+    if (*start == '\0' || *start == '#' || strncmp(start, "![", 2) == 0) {
       continue;
     }
     
-    preview = line;
+    preview = start;
     foundFirstParagraph = true;
     break;
   }
   
-  postFile.close();
-  
   if (!foundFirstParagraph) return "Preview not available.";
   
   // Truncate to ~200 characters
@@ -101,6 +268,15 @@ String getPostPreview(String filename) {
   return preview;
 }
 
+String getPostPreview(String filename) {
+  File postFile = openFile("/posts/" + filename, FILE_READ);
+  if (!postFile) return "Preview not available.";
+  
+  String preview = extractPostPreview(postFile);
+  postFile.close();
+  return preview;
+}
+
 // ============================================================================
 // HTML ESCAPING
 // ============================================================================
@@ -135,6 +311,10 @@ String getContentType(String filename) {
     return "text/html";
   } else if (filename.endsWith(".txt")) {
     return "text/plain";
+  } else if (filename.endsWith(".svg")) {
+    return "image/svg+xml";
+  } else if (filename.endsWith(".gz")) {
+    return "application/x-gzip";  // A sidecar fetched by its own name stays compressed
   }
   return "application/octet-stream";
 }
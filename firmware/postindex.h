@@ -0,0 +1,193 @@
+/*
+ * postindex.h - Post Metadata Index
+ *
+ * Keeps each post's preview text, size and modification time in
+ * /cache/index.bin so listing pages don't have to open every post. Sizes
+ * and times are also kept in RAM, for the validators of post pages.
+ */
+
+#ifndef POSTINDEX_H
+#define POSTINDEX_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "config.h"
+#include "parser.h"
+#include "storage.h"
+
+#define POST_INDEX_PATH "/cache/index.bin"
+#define POST_INDEX_TEMP_PATH "/cache/index.tmp"
+
+// One fixed-size record per entry in postMappings[], in the same order
+struct PostIndexEntry {
+  uint32_t nameHash;        // hashString() of the mapping's fileName
+  uint32_t fileSize;
+  uint32_t lastWrite;
+  uint16_t previewLength;
+  char preview[242];        // Pads the record to 256 bytes, two per SD sector
+};
+
+// Identify the current index for HTTP validators (see httpcache.h)
+uint32_t postIndexVersion = 0;    // Hash of all index entries
+time_t postIndexLastWrite = 0;    // Newest post modification time
+
+// Size and mtime of each post as last indexed, by route, so a post's
+// validators need no SD access; 8 bytes per route
+struct PostStamp {
+  uint32_t fileSize;
+  uint32_t lastWrite;
+};
+
+PostStamp* postStamps = nullptr;
+int postStampCount = 0;
+
+// ============================================================================
+// INDEX RECORDS
+// ============================================================================
+
+bool readIndexEntry(File& indexFile, int index, PostIndexEntry& entry) {
+  if (!indexFile.seek(index * sizeof(PostIndexEntry))) return false;
+  return readFile(indexFile, &entry, sizeof(entry)) == sizeof(entry);
+}
+
+void buildIndexEntry(const PostMapping& mapping, PostIndexEntry& entry) {
+  memset(&entry, 0, sizeof(entry));
+  entry.nameHash = hashString(mapping.fileName());
+  
+  String preview = "Preview not available.";
+  File postFile = openFile(String("/posts/") + mapping.fileName(), FILE_READ);
+  if (postFile) {
+    entry.fileSize = postFile.size();
+    entry.lastWrite = postFile.getLastWrite();
+    preview = extractPostPreview(postFile);
+    postFile.close();
+  }
+  
+  entry.previewLength = min((size_t)preview.length(), sizeof(entry.preview));
+  memcpy(entry.preview, preview.c_str(), entry.previewLength);
+}
+
+// An entry is still valid if it belongs to the same file and the file's
+// size and modification time haven't changed
+bool isIndexEntryCurrent(const PostMapping& mapping, const PostIndexEntry& entry) {
+  if (entry.nameHash != hashString(mapping.fileName())) return false;
+  
+  File postFile = openFile(String("/posts/") + mapping.fileName(), FILE_READ);
+  if (!postFile) return entry.fileSize == 0;
+  
+  bool current = (postFile.size() == entry.fileSize && (uint32_t)postFile.getLastWrite() == entry.lastWrite);
+  postFile.close();
+  return current;
+}
+
+// ============================================================================
+// INDEX MAINTENANCE
+// ============================================================================
+
+// Writes a fresh index next to the old one and swaps it in. Entries are
+// reused from the old index unless their post is changedFileName or, when
+// verifyAll is set, the post's size or mtime no longer match.
+void writePostIndex(const String& changedFileName, bool verifyAll) {
+  SD.mkdir("/cache");
+  SD.remove(POST_INDEX_TEMP_PATH);
+  
+  // Stamps from before this write may no longer match the posts
+  delete[] postStamps;
+  postStamps = nullptr;
+  postStampCount = 0;
+  
+  File oldIndex = openFile(POST_INDEX_PATH, FILE_READ);
+  File newIndex = openFile(POST_INDEX_TEMP_PATH, FILE_WRITE);
+  if (!newIndex) {
+    Serial.println("ERROR: Could not create " POST_INDEX_TEMP_PATH);
+    if (oldIndex) oldIndex.close();
+    return;
+  }
+  
+  PostStamp* stamps = new PostStamp[max(postMappingsCount, 1)];
+  
+  BufferedWriter writer(newIndex);
+  PostIndexEntry entry;
+  int rebuilt = 0;
+  uint32_t version = 2166136261UL;
+  time_t lastWrite = 0;
+  
+  for (int i = 0; i < postMappingsCount; i++) {
+    bool reuse = oldIndex && readIndexEntry(oldIndex, i, entry) &&
+                 changedFileName != postMappings[i].fileName() &&
+                 (verifyAll ? isIndexEntryCurrent(postMappings[i], entry)
+                            : entry.nameHash == hashString(postMappings[i].fileName()));
+    if (!reuse) {
+      buildIndexEntry(postMappings[i], entry);
+      rebuilt++;
+    }
+    writer.write((const uint8_t*)&entry, sizeof(entry));
+    stamps[i] = { entry.fileSize, entry.lastWrite };
+    version = hashBytes(&entry, sizeof(entry), version);
+    lastWrite = max(lastWrite, (time_t)entry.lastWrite);
+    yield();
+  }
+  
+  writer.flush();
+  newIndex.close();
+  if (oldIndex) oldIndex.close();
+  
+  // Taken from the posts, so valid even if the file below can't be swapped in
+  postStamps = stamps;
+  postStampCount = postMappingsCount;
+  
+  // A short write (full card) keeps the old index rather than a truncated one
+  if (writer.bytesWritten() != postMappingsCount * sizeof(PostIndexEntry)) {
+    Serial.println("ERROR: Could not write " POST_INDEX_TEMP_PATH);
+    SD.remove(POST_INDEX_TEMP_PATH);
+    return;
+  }
+  
+  SD.remove(POST_INDEX_PATH);
+  if (!SD.rename(POST_INDEX_TEMP_PATH, POST_INDEX_PATH)) {
+    Serial.println("ERROR: Could not replace " POST_INDEX_PATH);
+    return;
+  }
+  postIndexVersion = version;
+  postIndexLastWrite = lastWrite;
+  
+  Serial.printf("Post index: %d entries, %d rebuilt\n", postMappingsCount, rebuilt);
+}
+
+// Called at boot and on reload: checks every post against its entry
+void loadPostIndex() {
+  Serial.println("Updating post index...");
+  writePostIndex("", true);
+}
+
+// Called after a single post changes through the admin panel
+void updatePostIndex(const String& fileName) {
+  writePostIndex(fileName, false);
+}
+
+// ============================================================================
+// INDEX LOOKUP
+// ============================================================================
+
+// Size and mtime of the post of postMappings[index]; false if it wasn't
+// found when the index was last written
+bool findPostStamp(int index, PostStamp& stamp) {
+  if (index >= postStampCount || postStamps[index].fileSize == 0) return false;
+  stamp = postStamps[index];
+  return true;
+}
+
+// Preview for postMappings[index] from an open index, falling back to the
+// post itself if the index is missing or stale
+String readIndexedPreview(File& indexFile, int index) {
+  PostIndexEntry entry;
+  if (indexFile && readIndexEntry(indexFile, index, entry) &&
+      entry.nameHash == hashString(postMappings[index].fileName())) {
+    String preview;
+    preview.concat(entry.preview, entry.previewLength);
+    return preview;
+  }
+  return getPostPreview(postMappings[index].fileName());
+}
+
+#endif // POSTINDEX_H
@@ -0,0 +1,193 @@
+/*
+ * renderer.h - Streaming Page Rendering
+ *
+ * Functions for sending pages to the client with chunked transfer encoding,
+ * so a full page never has to be assembled in RAM
+ */
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include <SD.h>
+#include <functional>
+#include "config.h"
+#include "parser.h"
+#include "storage.h"
+
+// Called for each placeholder in a template; returns false if not handled
+typedef std::function<bool(TemplateVar var)> PlaceholderWriter;
+
+// ============================================================================
+// CHUNKED OUTPUT BUFFER
+// ============================================================================
+
+// Small writes are collected here and sent as one chunk when full
+char outputBuffer[RENDER_BUFFER_SIZE];
+size_t outputLength = 0;
+
+// When open, everything sent is also written here (see pagecache.h)
+File outputCapture;
+
+// Set by a short write to outputCapture, so a truncated page is never cached
+bool captureFailed = false;
+
+// When set, everything sent is also copied here, up to captureCapacity
+// bytes; a longer page moves to outputCapture in captureSpillPath
+char* captureBuffer = nullptr;
+size_t captureLength = 0;
+size_t captureCapacity = 0;
+String captureSpillPath;
+
+// Response body bytes sent since boot, reported by /admin/metrics
+uint64_t responseBytesSent = 0;
+
+void captureToFile(const char* data, size_t length) {
+  if (writeFile(outputCapture, data, length) != length) {
+    captureFailed = true;
+  }
+}
+
+void captureToRam(const char* data, size_t length) {
+  if (captureLength + length <= captureCapacity) {
+    memcpy(captureBuffer + captureLength, data, length);
+    captureLength += length;
+    return;
+  }
+  
+  // Too big for RAM: what's captured so far goes to SD, and the rest follows
+  SD.remove(captureSpillPath);
+  outputCapture = openFile(captureSpillPath, FILE_WRITE);
+  if (outputCapture) {
+    captureToFile(captureBuffer, captureLength);
+  }
+  delete[] captureBuffer;
+  captureBuffer = nullptr;
+}
+
+void flushOutput() {
+  if (outputLength > 0) {
+    server.sendContent(outputBuffer, outputLength);
+    responseBytesSent += outputLength;
+    if (captureBuffer) {
+      captureToRam(outputBuffer, outputLength);
+    }
+    if (outputCapture) {
+      captureToFile(outputBuffer, outputLength);
+    }
+    outputLength = 0;
+  }
+}
+
+void writeOutput(const char* data, size_t length) {
+  while (length > 0) {
+    size_t space = RENDER_BUFFER_SIZE - outputLength;
+    size_t n = (length < space) ? length : space;
+    memcpy(outputBuffer + outputLength, data, n);
+    outputLength += n;
+    data += n;
+    length -= n;
+    
+    if (outputLength == RENDER_BUFFER_SIZE) {
+      flushOutput();
+    }
+  }
+}
+
+void writeOutput(const String& text) {
+  writeOutput(text.c_str(), text.length());
+}
+
+void writeOutput(const char* text) {
+  writeOutput(text, strlen(text));
+}
+
+void writeOutput(char c) {
+  outputBuffer[outputLength++] = c;
+  if (outputLength == RENDER_BUFFER_SIZE) {
+    flushOutput();
+  }
+}
+
+// ============================================================================
+// CHUNKED RESPONSE
+// ============================================================================
+
+// Sends the response headers. Returns false for a HEAD request, which gets
+// no body: the caller skips rendering and endChunkedPage().
+bool beginChunkedPage(int statusCode, const char* contentType = "text/html") {
+  outputLength = 0;
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(statusCode, contentType, "");
+  return server.method() != HTTP_HEAD;
+}
+
+void endChunkedPage() {
+  flushOutput();
+  server.sendContent("");  // Zero-length chunk terminates the response
+}
+
+// ============================================================================
+// WHOLE RESPONSES
+// ============================================================================
+
+// server.send() for a body already built in RAM, counted in responseBytesSent
+void sendResponse(int statusCode, const char* contentType, const String& body) {
+  server.send(statusCode, contentType, body);
+  responseBytesSent += body.length();
+}
+
+// The same for a body in a RAM buffer; a HEAD request gets only the headers
+void sendBufferResponse(int statusCode, const char* contentType, const char* data, size_t length) {
+  server.setContentLength(length);
+  server.send(statusCode, contentType, "");
+  if (server.method() != HTTP_HEAD) {
+    server.sendContent(data, length);
+    responseBytesSent += length;
+  }
+}
+
+// server.streamFile(), counted as SD reads and bytes sent. A HEAD request
+// gets only the headers.
+void streamFileResponse(File& file, const String& contentType, int statusCode = 200) {
+  size_t sent = server.streamFile(file, contentType, server.method(), statusCode);
+  sdCounters.bytesRead += sent;
+  responseBytesSent += sent;
+}
+
+// ============================================================================
+// TEMPLATE STREAMING
+// ============================================================================
+
+// Walks a compiled template; no SD access or placeholder search per request
+void renderTemplate(PageTemplate page, PlaceholderWriter writePlaceholder) {
+  const CompiledTemplate& tpl = compiledTemplates[page];
+  
+  for (int i = 0; i < tpl.segmentCount; i++) {
+    const TemplateSegment& segment = tpl.segments[i];
+    writeOutput(tpl.text + segment.offset, segment.length);
+    
+    // Placeholders the page doesn't fill are left in the output untouched
+    if (segment.var != VAR_NONE && !writePlaceholder(segment.var)) {
+      writeOutput("{{");
+      writeOutput(templateVarNames[segment.var]);
+      writeOutput("}}");
+    }
+  }
+}
+
+// Writes text with HTML special characters escaped; safe inside attributes
+void writeEscaped(const char* text, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    char c = text[i];
+    if (c == '<') writeOutput("&lt;", 4);
+    else if (c == '>') writeOutput("&gt;", 4);
+    else if (c == '&') writeOutput("&amp;", 5);
+    else if (c == '"') writeOutput("&quot;", 6);
+    else if (c == '\'') writeOutput("&#39;", 5);
+    else writeOutput(c);
+  }
+}
+
+#endif // RENDERER_H
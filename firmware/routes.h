@@ -0,0 +1,286 @@
+/*
+ * routes.h - Route Tables
+ *
+ * Compiles routes.txt and redirects.txt into binary files that load with a
+ * single read, and keeps a hash index over postMappings[] and
+ * redirections[] so resolving a request path costs the same no matter how
+ * many routes are loaded. Blog posts are also listed on their own for
+ * the paginated listing pages.
+ */
+
+#ifndef ROUTES_H
+#define ROUTES_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "config.h"
+#include "parser.h"
+#include "storage.h"
+
+#define ROUTE_FILE_MAGIC 0x31425452UL  // "RTB1"
+
+// Written after the string block, so a half-written file never validates
+struct RouteFileFooter {
+  uint32_t magic;
+  uint32_t sourceSize;        // routes.txt / redirects.txt this was built from
+  uint32_t sourceLastWrite;
+  uint32_t entryCount;
+  uint32_t stringBytes;
+};
+
+// Identify the loaded routes for HTTP validators (see httpcache.h)
+uint32_t routesVersion = 0;       // Hash of the route string block
+time_t routesLastWrite = 0;       // Modification time of routes.txt
+
+// Lookup key of each table entry
+const char* pathKey(const PostMapping& mapping) { return mapping.urlPath(); }
+const char* pathKey(const Redirection& redirection) { return redirection.fromPath(); }
+
+// ============================================================================
+// COMPILED ROUTE FILES
+// ============================================================================
+
+// Calls addEntry(entry, bytes) for each line of a text table, with the
+// line turned into fieldCount NUL-terminated strings, in one pass without
+// allocating per line
+template <typename EntryHandler>
+void parseRouteFile(File& source, int fieldCount, EntryHandler addEntry, bool warn = true) {
+  BufferedReader reader(source);
+  char line[256];
+  size_t lineLength;
+  uint32_t stringBytes = 0;
+  
+  source.seek(0);
+  while (reader.readLine(line, sizeof(line), &lineLength)) {
+    if (warn && lineLength == sizeof(line) - 1) {
+      Serial.printf("WARNING: Line truncated to %u bytes\n", (unsigned)lineLength);
+    }
+    
+    // Trim in place
+    char* start = line;
+    while (*start == ' ' || *start == '\t') start++;
+    char* end = line + lineLength;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    *end = '\0';
+    
+    if (*start == '\0' || *start == '#' || *start == '|') continue;
+    
+    // The first fieldCount - 1 pipes separate fields; the last field may contain more
+    int fields = 1;
+    for (char* p = start; *p && fields < fieldCount; p++) {
+      if (*p == '|') {
+        *p = '\0';
+        fields++;
+      }
+    }
+    if (fields < fieldCount) continue;
+    
+    size_t entryBytes = end - start + 1;
+    if (stringBytes + entryBytes > 0xFFFF) {
+      if (warn) Serial.println("WARNING: Table larger than 64KB, ignoring the rest");
+      break;
+    }
+    addEntry(start, entryBytes);
+    stringBytes += entryBytes;
+  }
+}
+
+// Writes the string block of a text table to binPath, by way of a temp file
+bool compileRouteFile(File& source, const char* binPath, int fieldCount) {
+  String tempPath = String(binPath) + ".tmp";
+  SD.mkdir("/cache");
+  SD.remove(tempPath);
+  
+  File binFile = openFile(tempPath, FILE_WRITE);
+  if (!binFile) {
+    Serial.println("ERROR: Could not create " + tempPath);
+    return false;
+  }
+  
+  RouteFileFooter footer = { ROUTE_FILE_MAGIC, (uint32_t)source.size(), (uint32_t)source.getLastWrite(), 0, 0 };
+  BufferedWriter writer(binFile);
+  parseRouteFile(source, fieldCount, [&](const char* entry, size_t bytes) {
+    writer.write((const uint8_t*)entry, bytes);
+    footer.stringBytes += bytes;
+    footer.entryCount++;
+  });
+  
+  writer.write((const uint8_t*)&footer, sizeof(footer));
+  writer.flush();
+  binFile.close();
+  
+  if (writer.bytesWritten() != footer.stringBytes + sizeof(footer)) {
+    Serial.println("ERROR: Could not write " + tempPath);
+    SD.remove(tempPath);
+    return false;
+  }
+  
+  SD.remove(binPath);
+  return SD.rename(tempPath, binPath);
+}
+
+// Fallback when the binary can't be written: parses the text file straight
+// into a string block. Returns the entry count.
+int readRouteFile(File& source, int fieldCount, char*& strings) {
+  uint32_t stringBytes = 0;
+  int count = 0;
+  parseRouteFile(source, fieldCount, [&](const char* entry, size_t bytes) {
+    stringBytes += bytes;
+    count++;
+  });
+  
+  strings = new char[stringBytes > 0 ? stringBytes : 1];
+  uint32_t offset = 0;
+  parseRouteFile(source, fieldCount, [&](const char* entry, size_t bytes) {
+    memcpy(strings + offset, entry, bytes);
+    offset += bytes;
+  }, false);
+  return count;
+}
+
+// Loads the string block for a table, recompiling it first if the text file
+// changed since the binary was built. Returns the entry count, or -1.
+int loadRouteFile(const char* textPath, const char* binPath, int fieldCount, char*& strings, bool allowCompile = true) {
+  File source = openFile(textPath, FILE_READ);
+  if (!source) {
+    return -1;
+  }
+  
+  RouteFileFooter footer;
+  File binFile = openFile(binPath, FILE_READ);
+  bool valid = binFile && binFile.size() >= sizeof(footer) &&
+               binFile.seek(binFile.size() - sizeof(footer)) &&
+               readFile(binFile, &footer, sizeof(footer)) == sizeof(footer) &&
+               footer.magic == ROUTE_FILE_MAGIC &&
+               footer.sourceSize == source.size() &&
+               footer.sourceLastWrite == (uint32_t)source.getLastWrite() &&
+               binFile.size() == footer.stringBytes + sizeof(footer);
+  
+  if (!valid) {
+    if (binFile) binFile.close();
+    if (allowCompile) {
+      Serial.printf("Compiling %s\n", textPath);
+      if (compileRouteFile(source, binPath, fieldCount)) {
+        source.close();
+        return loadRouteFile(textPath, binPath, fieldCount, strings, false);
+      }
+    }
+    
+    // A full or write-protected card still gets its routes, just uncached
+    Serial.printf("WARNING: Could not cache %s, reading it directly\n", textPath);
+    int count = readRouteFile(source, fieldCount, strings);
+    source.close();
+    return count;
+  }
+  source.close();
+  
+  binFile.seek(0);
+  strings = new char[footer.stringBytes];
+  size_t bytesRead = readFile(binFile, strings, footer.stringBytes);
+  binFile.close();
+  
+  if (bytesRead != footer.stringBytes) {
+    delete[] strings;
+    strings = nullptr;
+    return -1;
+  }
+  return footer.entryCount;
+}
+
+// Offset of the string after the one starting at offset
+uint16_t nextStringOffset(const char* strings, uint16_t offset) {
+  return offset + strlen(strings + offset) + 1;
+}
+
+// ============================================================================
+// INDEX BUILDING
+// ============================================================================
+
+void freePathIndex(PathIndex& index) {
+  delete[] index.slots;
+  index.slots = nullptr;
+  index.mask = 0;
+}
+
+// Entries must already have pathHash set. The table is kept at most 75% full
+// so probe sequences stay short.
+template <typename Entry>
+void buildPathIndex(PathIndex& index, const Entry* entries, int count) {
+  freePathIndex(index);
+  if (count <= 0) return;
+  
+  uint32_t slotCount = 8;
+  while (slotCount * 3 < (uint32_t)count * 4) {
+    slotCount <<= 1;
+  }
+  
+  index.slots = new uint16_t[slotCount]();
+  index.mask = slotCount - 1;
+  
+  // Earlier entries claim earlier probe positions, so duplicate paths
+  // resolve to the first one listed, as the linear scan used to
+  for (int i = 0; i < count && i < 0xFFFF; i++) {
+    uint32_t slot = entries[i].pathHash & index.mask;
+    while (index.slots[slot] != 0) {
+      slot = (slot + 1) & index.mask;
+    }
+    index.slots[slot] = i + 1;
+  }
+}
+
+// ============================================================================
+// LOOKUP
+// ============================================================================
+
+// Returns the entry index for path, or -1 if there is none
+template <typename Entry>
+int findPath(const PathIndex& index, const Entry* entries, const String& path) {
+  if (index.slots == nullptr) return -1;
+  
+  uint32_t hash = hashString(path.c_str());
+  uint32_t slot = hash & index.mask;
+  
+  while (index.slots[slot] != 0) {
+    const Entry& entry = entries[index.slots[slot] - 1];
+    if (entry.pathHash == hash && strcmp(pathKey(entry), path.c_str()) == 0) {
+      return index.slots[slot] - 1;
+    }
+    slot = (slot + 1) & index.mask;
+  }
+  return -1;
+}
+
+int findPostMapping(const String& path) {
+  return findPath(postMappingIndex, postMappings, path);
+}
+
+int findRedirection(const String& path) {
+  return findPath(redirectionIndex, redirections, path);
+}
+
+// ============================================================================
+// BLOG POST LIST
+// ============================================================================
+
+// postMappings[] indexes of the blog posts in routes.txt order, so a
+// listing page is a slice of this instead of a scan over every route
+uint16_t* blogPosts = nullptr;
+int blogPostCount = 0;
+
+// Called whenever postMappings[] is loaded
+void buildBlogPostList() {
+  delete[] blogPosts;
+  blogPostCount = 0;
+  
+  int count = 0;
+  for (int i = 0; i < postMappingsCount; i++) {
+    if (postMappings[i].isBlogPost()) count++;
+  }
+  
+  blogPosts = new uint16_t[max(count, 1)];
+  for (int i = 0; i < postMappingsCount; i++) {
+    if (postMappings[i].isBlogPost()) blogPosts[blogPostCount++] = i;
+  }
+}
+
+#endif // ROUTES_H
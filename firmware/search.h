@@ -0,0 +1,690 @@
+/*
+ * search.h - Full-Text Search Index
+ *
+ * Keeps an inverted index of every route's title and post in
+ * /cache/search.bin: for each term, the routes that contain it. A query
+ * reads only the dictionary entries and posting lists of its own terms.
+ * The index is brought up to date in the background, a few milliseconds
+ * per loop(), after boot, a reload or a post saved through the admin
+ * panel; only posts that changed are read again.
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#if ENABLE_SEARCH && !SERVE_PREBUILT_SITE
+
+#include <Arduino.h>
+#include <SD.h>
+#include <algorithm>
+#include "config.h"
+#include "parser.h"
+#include "postindex.h"
+#include "storage.h"
+
+#define SEARCH_INDEX_PATH "/cache/search.bin"
+#define SEARCH_TEMP_PATH "/cache/search.tmp"
+#define SEARCH_DICTIONARY_TEMP_PATH "/cache/search.dic"
+#define SEARCH_FILE_MAGIC 0x31585253UL  // "SRX1"
+
+const int SEARCH_MIN_TERM_LENGTH = 2;    // Bytes; shorter words aren't indexed
+const int SEARCH_MAX_QUERY_TERMS = 8;    // Further query words are ignored
+const int SEARCH_MIN_BUILD_PAIRS = 256;  // Smallest batch worth starting an update with
+
+// The file holds the posting lists, one fingerprint per route, the term
+// dictionary sorted by term hash and then this footer. The footer is
+// written last, so a half-written file never validates.
+struct SearchFooter {
+  uint32_t magic;
+  uint32_t routeCount;
+  uint32_t termCount;
+  uint32_t fingerprintsOffset;
+  uint32_t dictionaryOffset;
+};
+
+// A term's routes are stored in ascending order as varint gaps, the first
+// one counted from route 0
+struct SearchTerm {
+  uint32_t termHash;
+  uint32_t postingsOffset;
+  uint32_t postingCount;
+};
+
+// ============================================================================
+// TERMS
+// ============================================================================
+
+// Splits text into terms one byte at a time: runs of letters and digits,
+// with ASCII and accented Latin capitals folded to lower case. Terms are
+// kept only as their FNV-1a hash, so a word of any length needs no buffer.
+class TermSplitter {
+ public:
+  // True unless a term or a multi-byte separator is under way
+  bool betweenTerms() const {
+    return length == 0 && !pendingLead && skipBytes == 0;
+  }
+  
+  // Takes the next byte, or -1 at the end of the text. Returns true when
+  // that ends a term, with its hash in term.
+  bool feed(int c, uint32_t& term) {
+    // UTF-8 punctuation (U+2000 to U+207F: dashes, curly quotes) separates
+    // words; anything else non-ASCII is part of one
+    if (pendingLead) {
+      pendingLead = false;
+      if (c == 0x80 || c == 0x81) {
+        skipBytes = 1;
+        return endTerm(term);
+      }
+      add(0xE2);
+    }
+    if (skipBytes > 0) {
+      skipBytes--;
+      return false;
+    }
+    if (c == 0xE2) {
+      pendingLead = true;
+      return false;
+    }
+    
+    if (c >= 'A' && c <= 'Z') {
+      add(c + ('a' - 'A'));
+    } else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+      add(c);
+    } else if (c >= 0x80) {
+      // U+00C0 to U+00DE (C3 80 to C3 9E, except the multiplication sign)
+      bool capital = previous == 0xC3 && c <= 0x9E && c != 0x97;
+      add(capital ? c + 0x20 : c);
+    } else {
+      return endTerm(term);
+    }
+    return false;
+  }
+ 
+ private:
+  uint32_t hash = 2166136261UL;
+  int length = 0;
+  int previous = 0;
+  bool pendingLead = false;
+  int skipBytes = 0;
+  
+  void add(int c) {
+    hash = (hash ^ (uint8_t)c) * 16777619UL;
+    length++;
+    previous = c;
+  }
+  
+  bool endTerm(uint32_t& term) {
+    bool ended = length >= SEARCH_MIN_TERM_LENGTH;
+    term = hash;
+    hash = 2166136261UL;
+    length = 0;
+    previous = 0;
+    return ended;
+  }
+};
+
+// ============================================================================
+// INDEX FILE
+// ============================================================================
+
+bool readSearchFooter(File& indexFile, SearchFooter& footer) {
+  return indexFile.size() >= sizeof(footer) &&
+         indexFile.seek(indexFile.size() - sizeof(footer)) &&
+         readFile(indexFile, &footer, sizeof(footer)) == sizeof(footer) &&
+         footer.magic == SEARCH_FILE_MAGIC &&
+         footer.dictionaryOffset + footer.termCount * sizeof(SearchTerm) + sizeof(footer) == indexFile.size();
+}
+
+bool readVarint(BufferedReader& reader, uint32_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int c = reader.read();
+    if (c < 0) return false;
+    value |= (uint32_t)(c & 0x7F) << shift;
+    if (c < 0x80) return true;
+  }
+  return false;
+}
+
+void writeVarint(BufferedWriter& writer, uint32_t value, uint32_t& bytesWritten) {
+  while (value >= 0x80) {
+    writer.write((uint8_t)(value | 0x80));
+    value >>= 7;
+    bytesWritten++;
+  }
+  writer.write((uint8_t)value);
+  bytesWritten++;
+}
+
+// Identifies what a route's postings were built from: its file name and
+// title, and the size and mtime the post index has for its post
+uint32_t routeFingerprint(File& postIndexFile, int route) {
+  const PostMapping& mapping = postMappings[route];
+  uint32_t nameHash = hashString(mapping.fileName());
+  uint32_t hash = hashBytes(mapping.title(), strlen(mapping.title()), nameHash);
+  
+  PostIndexEntry entry;
+  if (postIndexFile && readIndexEntry(postIndexFile, route, entry) && entry.nameHash == nameHash) {
+    hash = hashBytes(&entry.fileSize, sizeof(entry.fileSize), hash);
+    hash = hashBytes(&entry.lastWrite, sizeof(entry.lastWrite), hash);
+  }
+  return hash ? hash : 1;  // 0 means not indexed
+}
+
+// ============================================================================
+// INDEX UPDATES
+// ============================================================================
+
+// Set when a route may have changed since the index was last brought up to date
+bool searchIndexStale = true;
+
+enum SearchBuildPhase : uint8_t { SEARCH_COLLECT, SEARCH_MERGE };
+
+// One pass over the old index, rewriting it with a batch of re-read posts
+struct SearchMerge {
+  File oldIndex;       // Dictionary reads
+  File oldPostings;    // Posting list reads, which follow dictionary order
+  File newIndex;
+  File newDictionary;
+  BufferedReader dictionaryReader;
+  BufferedReader postingsReader;
+  BufferedWriter indexWriter;
+  BufferedWriter dictionaryWriter;
+  
+  uint32_t oldTermsLeft = 0;
+  bool haveOldTerm = false;
+  SearchTerm oldTerm;
+  int pairPosition = 0;       // Next batch pair to merge
+  uint32_t termCount = 0;
+  uint32_t postingsBytes = 0;
+  
+  SearchMerge()
+      : dictionaryReader(oldIndex), postingsReader(oldPostings),
+        indexWriter(newIndex), dictionaryWriter(newDictionary) {}
+};
+
+// Everything an update needs, allocated only while one runs. Routes are
+// checked in order; those that changed are read into a batch of pairs,
+// and each full batch is merged into the index file. A post with more
+// terms than a batch holds is carried on in the next one.
+struct SearchBuild {
+  SearchBuildPhase phase;
+  int routeCount;            // postMappingsCount when the update started
+  bool routeCountChanged;    // Postings of routes past the end must go
+  uint32_t* fingerprints;    // What each route's postings come from, 0 = none
+  uint8_t* batchRoutes;      // Bit per route whose old postings this batch drops
+  int batchRouteCount;
+  int nextRoute;
+  uint32_t resumeOffset;     // Where nextRoute's post carries on, 0 = from its title
+  uint64_t* pairs;           // termHash << 16 | route
+  int pairCount;
+  int pairCapacity;
+  SearchMerge* merge;
+  int postsRead;
+  unsigned long startedAt;
+};
+
+SearchBuild* searchBuild = nullptr;
+
+void freeSearchBuild() {
+  if (!searchBuild) return;
+  if (searchBuild->merge) {
+    SearchMerge* merge = searchBuild->merge;
+    if (merge->oldIndex) merge->oldIndex.close();
+    if (merge->oldPostings) merge->oldPostings.close();
+    if (merge->newIndex) merge->newIndex.close();
+    if (merge->newDictionary) merge->newDictionary.close();
+    delete merge;
+    SD.remove(SEARCH_TEMP_PATH);
+    SD.remove(SEARCH_DICTIONARY_TEMP_PATH);
+  }
+  delete[] searchBuild->fingerprints;
+  delete[] searchBuild->batchRoutes;
+  delete[] searchBuild->pairs;
+  delete searchBuild;
+  searchBuild = nullptr;
+}
+
+bool startSearchBuild() {
+  // The batch gets whatever heap the rest of the update leaves, up to
+  // SEARCH_BUILD_PAIRS
+  uint32_t reserved = SEARCH_MIN_FREE_HEAP + sizeof(SearchBuild) + sizeof(SearchMerge) +
+                      postMappingsCount * sizeof(uint32_t) + postMappingsCount / 8 + 1;
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint32_t spare = freeHeap > reserved ? (freeHeap - reserved) / sizeof(uint64_t) : 0;
+  int capacity = min(spare, (uint32_t)SEARCH_BUILD_PAIRS);
+  if (capacity < SEARCH_MIN_BUILD_PAIRS) {
+    return false;  // Tried again on a later loop()
+  }
+  
+  SearchBuild* build = new SearchBuild();
+  build->routeCount = postMappingsCount;
+  build->fingerprints = new uint32_t[max(postMappingsCount, 1)]();
+  build->batchRoutes = new uint8_t[postMappingsCount / 8 + 1]();
+  build->pairs = new uint64_t[capacity];
+  build->pairCapacity = capacity;
+  build->startedAt = millis();
+  
+  // Routes whose fingerprint still matches the index are left alone
+  SearchFooter footer;
+  File indexFile = openFile(SEARCH_INDEX_PATH, FILE_READ);
+  if (indexFile && readSearchFooter(indexFile, footer)) {
+    int known = min((int)footer.routeCount, postMappingsCount);
+    indexFile.seek(footer.fingerprintsOffset);
+    readFile(indexFile, build->fingerprints, known * sizeof(uint32_t));
+    build->routeCountChanged = (footer.routeCount != (uint32_t)postMappingsCount);
+  } else {
+    build->routeCountChanged = true;
+  }
+  if (indexFile) indexFile.close();
+  
+  searchBuild = build;
+  searchIndexStale = false;
+  return true;
+}
+
+void finishSearchBuild() {
+  if (searchBuild->postsRead > 0) {
+    Serial.printf("Search index: %d posts read in %lu ms\n", searchBuild->postsRead, millis() - searchBuild->startedAt);
+  }
+  freeSearchBuild();
+}
+
+// Sorts pairs[start..] and drops repeated terms
+void compactSearchPairs(int start) {
+  SearchBuild* build = searchBuild;
+  std::sort(build->pairs + start, build->pairs + build->pairCount);
+  build->pairCount = std::unique(build->pairs + start, build->pairs + build->pairCount) - build->pairs;
+}
+
+bool addSearchPair(uint32_t term, int route, int start) {
+  SearchBuild* build = searchBuild;
+  if (build->pairCount == build->pairCapacity) {
+    compactSearchPairs(start);
+    // Nearly full even without repeats: sorting again per word would crawl
+    if (build->pairCount > build->pairCapacity - build->pairCapacity / 16) return false;
+  }
+  build->pairs[build->pairCount++] = ((uint64_t)term << 16) | route;
+  return true;
+}
+
+// Adds a route's terms to the batch, from its title and post or from
+// resumeOffset in the post. Returns false if the batch filled up first;
+// resumeOffset then says where the next batch carries on.
+bool collectRouteTerms(int route) {
+  SearchBuild* build = searchBuild;
+  const PostMapping& mapping = postMappings[route];
+  int start = build->pairCount;
+  TermSplitter splitter;
+  uint32_t term;
+  bool fits = true;
+  
+  if (build->resumeOffset == 0) {
+    for (const char* p = mapping.title(); fits; p++) {
+      if (splitter.feed(*p ? (uint8_t)*p : ' ', term)) fits = addSearchPair(term, route, start);
+      if (!*p) break;
+    }
+  }
+  
+  File postFile = openFile(String("/posts/") + mapping.fileName(), FILE_READ);
+  if (postFile && fits && postFile.seek(build->resumeOffset)) {
+    BufferedReader reader(postFile);
+    uint32_t position = build->resumeOffset;
+    uint32_t termStart = position;
+    int c;
+    do {
+      if (splitter.betweenTerms()) termStart = position;
+      c = reader.read();
+      position++;
+      if (splitter.feed(c, term) && !addSearchPair(term, route, start)) {
+        build->resumeOffset = termStart;
+        fits = false;
+      }
+    } while (c >= 0 && fits);
+  }
+  if (postFile) postFile.close();
+  if (fits) {
+    build->resumeOffset = 0;
+    build->postsRead++;
+  }
+  
+  compactSearchPairs(start);
+  return fits;
+}
+
+void startSearchMerge();
+
+// Checks routes against their fingerprints and reads those that changed
+void collectSearchBatch() {
+  SearchBuild* build = searchBuild;
+  unsigned long started = millis();
+  File postIndexFile = openFile(POST_INDEX_PATH, FILE_READ);
+  
+  while (build->nextRoute < build->routeCount && millis() - started < SEARCH_STEP_MS) {
+    int route = build->nextRoute;
+    uint32_t fingerprint = routeFingerprint(postIndexFile, route);
+    if (build->resumeOffset == 0) {
+      if (fingerprint == build->fingerprints[route]) {
+        build->nextRoute++;
+        continue;
+      }
+      build->batchRoutes[route / 8] |= 1 << (route % 8);
+      build->batchRouteCount++;
+    }
+    
+    if (!collectRouteTerms(route)) {
+      if (postIndexFile) postIndexFile.close();
+      startSearchMerge();
+      return;
+    }
+    
+    // Recorded only once all of it is in, so a query never trusts half a post
+    build->fingerprints[route] = fingerprint;
+    build->nextRoute++;
+  }
+  if (postIndexFile) postIndexFile.close();
+  
+  if (build->nextRoute == build->routeCount) {
+    if (build->batchRouteCount > 0 || build->pairCount > 0 || build->routeCountChanged) {
+      startSearchMerge();
+    } else {
+      finishSearchBuild();
+    }
+  }
+}
+
+void readOldSearchTerm(SearchMerge* merge) {
+  merge->haveOldTerm = merge->oldTermsLeft > 0 &&
+      merge->dictionaryReader.read((uint8_t*)&merge->oldTerm, sizeof(SearchTerm)) == sizeof(SearchTerm);
+  if (merge->haveOldTerm) merge->oldTermsLeft--;
+}
+
+void startSearchMerge() {
+  SearchBuild* build = searchBuild;
+  std::sort(build->pairs, build->pairs + build->pairCount);
+  
+  SearchMerge* merge = new SearchMerge();
+  build->merge = merge;
+  build->phase = SEARCH_MERGE;
+  
+  SearchFooter footer;
+  merge->oldIndex = openFile(SEARCH_INDEX_PATH, FILE_READ);
+  if (merge->oldIndex && readSearchFooter(merge->oldIndex, footer)) {
+    merge->oldPostings = openFile(SEARCH_INDEX_PATH, FILE_READ);
+    merge->oldIndex.seek(footer.dictionaryOffset);
+    merge->oldTermsLeft = footer.termCount;
+  }
+  
+  SD.mkdir("/cache");
+  SD.remove(SEARCH_TEMP_PATH);
+  SD.remove(SEARCH_DICTIONARY_TEMP_PATH);
+  merge->newIndex = openFile(SEARCH_TEMP_PATH, FILE_WRITE);
+  merge->newDictionary = openFile(SEARCH_DICTIONARY_TEMP_PATH, FILE_WRITE);
+  if (!merge->newIndex || !merge->newDictionary) {
+    Serial.println("ERROR: Could not create " SEARCH_TEMP_PATH);
+    freeSearchBuild();
+    return;
+  }
+  readOldSearchTerm(merge);
+}
+
+void finishSearchMerge() {
+  SearchBuild* build = searchBuild;
+  SearchMerge* merge = build->merge;
+  
+  // Postings are already in place; fingerprints, dictionary and footer follow
+  uint32_t fingerprintsOffset = merge->postingsBytes;
+  uint32_t dictionaryOffset = fingerprintsOffset + build->routeCount * sizeof(uint32_t);
+  merge->indexWriter.write((const uint8_t*)build->fingerprints, build->routeCount * sizeof(uint32_t));
+  merge->indexWriter.flush();
+  merge->dictionaryWriter.flush();
+  merge->newDictionary.close();
+  
+  File dictionary = openFile(SEARCH_DICTIONARY_TEMP_PATH, FILE_READ);
+  size_t copied = dictionary ? copyFile(dictionary, merge->newIndex) : 0;
+  if (dictionary) dictionary.close();
+  
+  SearchFooter footer = { SEARCH_FILE_MAGIC, (uint32_t)build->routeCount, merge->termCount,
+                          fingerprintsOffset, dictionaryOffset };
+  writeFile(merge->newIndex, &footer, sizeof(footer));
+  bool complete = copied == merge->termCount * sizeof(SearchTerm) &&
+                  merge->newIndex.size() == dictionaryOffset + copied + sizeof(footer);
+  uint32_t termCount = merge->termCount;
+  
+  merge->newIndex.close();
+  if (merge->oldIndex) merge->oldIndex.close();
+  if (merge->oldPostings) merge->oldPostings.close();
+  delete merge;
+  build->merge = nullptr;
+  SD.remove(SEARCH_DICTIONARY_TEMP_PATH);
+  
+  SD.remove(complete ? SEARCH_INDEX_PATH : SEARCH_TEMP_PATH);
+  if (!complete || !SD.rename(SEARCH_TEMP_PATH, SEARCH_INDEX_PATH)) {
+    Serial.println("ERROR: Could not replace " SEARCH_INDEX_PATH);
+    freeSearchBuild();
+    return;
+  }
+  Serial.printf("Search index: %d posts merged, %u terms\n", build->batchRouteCount, termCount);
+  
+  // On to the next batch, if any routes are left to check
+  build->phase = SEARCH_COLLECT;
+  build->pairCount = 0;
+  build->batchRouteCount = 0;
+  build->routeCountChanged = false;
+  memset(build->batchRoutes, 0, build->routeCount / 8 + 1);
+  if (build->nextRoute == build->routeCount) {
+    finishSearchBuild();
+  }
+}
+
+// Writes dictionary entries of the new index for SEARCH_STEP_MS: the old
+// postings minus those of re-read routes, plus the batch's
+void mergeSearchTerms() {
+  SearchBuild* build = searchBuild;
+  SearchMerge* merge = build->merge;
+  unsigned long started = millis();
+  
+  do {
+    bool haveNew = merge->pairPosition < build->pairCount;
+    if (!merge->haveOldTerm && !haveNew) {
+      finishSearchMerge();
+      return;
+    }
+    
+    uint32_t newHash = haveNew ? (uint32_t)(build->pairs[merge->pairPosition] >> 16) : 0;
+    uint32_t termHash = !haveNew ? merge->oldTerm.termHash
+                      : !merge->haveOldTerm ? newHash
+                      : min(newHash, merge->oldTerm.termHash);
+    bool mergeOld = merge->haveOldTerm && merge->oldTerm.termHash == termHash;
+    
+    // Both lists are in route order, so they merge like sorted arrays
+    uint32_t oldLeft = mergeOld ? merge->oldTerm.postingCount : 0;
+    uint32_t oldRoute = 0;
+    int32_t nextOld = -1;
+    uint32_t gap;
+    if (oldLeft > 0 && readVarint(merge->postingsReader, gap)) {
+      oldRoute += gap;
+      nextOld = oldRoute;
+      oldLeft--;
+    }
+    
+    SearchTerm entry = { termHash, merge->postingsBytes, 0 };
+    uint32_t lastRoute = 0;
+    while (true) {
+      bool newNext = merge->pairPosition < build->pairCount &&
+                     (uint32_t)(build->pairs[merge->pairPosition] >> 16) == termHash;
+      int32_t nextNew = newNext ? (int32_t)(build->pairs[merge->pairPosition] & 0xFFFF) : -1;
+      if (nextNew < 0 && nextOld < 0) break;
+      
+      uint32_t route;
+      bool keep = true;
+      if (nextNew >= 0 && (nextOld < 0 || nextNew < nextOld)) {
+        route = nextNew;
+        merge->pairPosition++;
+      } else {
+        route = nextOld;
+        keep = route < (uint32_t)build->routeCount && !(build->batchRoutes[route / 8] & (1 << (route % 8)));
+        nextOld = -1;
+        if (oldLeft > 0 && readVarint(merge->postingsReader, gap)) {
+          oldRoute += gap;
+          nextOld = oldRoute;
+          oldLeft--;
+        }
+      }
+      // A post split across batches can bring a term its earlier part had
+      if (!keep || (entry.postingCount > 0 && route == lastRoute)) continue;
+      
+      writeVarint(merge->indexWriter, route - lastRoute, merge->postingsBytes);
+      lastRoute = route;
+      entry.postingCount++;
+    }
+    
+    if (entry.postingCount > 0) {
+      merge->dictionaryWriter.write((const uint8_t*)&entry, sizeof(entry));
+      merge->termCount++;
+    }
+    if (mergeOld) readOldSearchTerm(merge);
+  } while (millis() - started < SEARCH_STEP_MS);
+}
+
+// Called from loop(): brings the index up to date SEARCH_STEP_MS at a
+// time, so requests are never held up for long
+void serviceSearchIndex() {
+  if (!searchBuild && (!searchIndexStale || !startSearchBuild())) return;
+  
+  if (searchBuild->phase == SEARCH_COLLECT) {
+    collectSearchBatch();
+  } else {
+    mergeSearchTerms();
+  }
+}
+
+// Called at boot and on reload: route numbers may have changed, so any
+// update in progress starts over
+void loadSearchIndex() {
+  freeSearchBuild();
+  searchIndexStale = true;
+}
+
+// Called after a post changes through the admin panel
+void updateSearchIndex() {
+  searchIndexStale = true;
+}
+
+// True while some changes may not be searchable yet
+bool isSearchIndexUpdating() {
+  return searchIndexStale || searchBuild != nullptr;
+}
+
+// ============================================================================
+// QUERIES
+// ============================================================================
+
+// Binary search of the dictionary on SD: about log2(terms) 12-byte reads
+bool findSearchTerm(File& indexFile, const SearchFooter& footer, uint32_t termHash, SearchTerm& term) {
+  uint32_t low = 0;
+  uint32_t high = footer.termCount;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    if (!indexFile.seek(footer.dictionaryOffset + middle * sizeof(SearchTerm)) ||
+        readFile(indexFile, &term, sizeof(term)) != sizeof(term)) {
+      return false;
+    }
+    if (term.termHash == termHash) return true;
+    if (term.termHash < termHash) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return false;
+}
+
+// Routes whose title or post contains every word of query, in routes.txt
+// order. Stores up to maxResults of them in results and returns how many;
+// matchCount gets the number of matches in all. Reads only the query
+// terms' postings, plus one fingerprint per result to skip routes that
+// changed since they were indexed.
+int searchPosts(const String& query, uint16_t* results, int maxResults, int& matchCount) {
+  matchCount = 0;
+  
+  uint32_t hashes[SEARCH_MAX_QUERY_TERMS];
+  int hashCount = 0;
+  TermSplitter splitter;
+  uint32_t term;
+  for (size_t i = 0; i <= query.length() && hashCount < SEARCH_MAX_QUERY_TERMS; i++) {
+    int c = i < query.length() ? (uint8_t)query[i] : -1;
+    if (splitter.feed(c, term) && std::find(hashes, hashes + hashCount, term) == hashes + hashCount) {
+      hashes[hashCount++] = term;
+    }
+  }
+  if (hashCount == 0) return 0;
+  
+  SearchFooter footer;
+  File indexFile = openFile(SEARCH_INDEX_PATH, FILE_READ);
+  if (!indexFile) return 0;
+  if (!readSearchFooter(indexFile, footer)) {
+    indexFile.close();
+    return 0;
+  }
+  
+  // Every word must be indexed at all, or nothing matches
+  SearchTerm terms[SEARCH_MAX_QUERY_TERMS];
+  for (int i = 0; i < hashCount; i++) {
+    if (!findSearchTerm(indexFile, footer, hashes[i], terms[i])) {
+      indexFile.close();
+      return 0;
+    }
+  }
+  
+  // The rarest term's routes bound the result; the others only remove some
+  std::sort(terms, terms + hashCount, [](const SearchTerm& a, const SearchTerm& b) {
+    return a.postingCount < b.postingCount;
+  });
+  uint16_t* matches = new uint16_t[max(terms[0].postingCount, (uint32_t)1)];
+  int count = 0;
+  for (int i = 0; i < hashCount && (i == 0 || count > 0); i++) {
+    indexFile.seek(terms[i].postingsOffset);
+    BufferedReader reader(indexFile);
+    uint32_t route = 0;
+    uint32_t gap;
+    int kept = 0;
+    int position = 0;
+    for (uint32_t n = 0; n < terms[i].postingCount && readVarint(reader, gap); n++) {
+      route += gap;
+      if (i == 0) {
+        matches[count++] = route;
+        continue;
+      }
+      while (position < count && matches[position] < route) position++;
+      if (position == count) break;
+      if (matches[position] == route) matches[kept++] = route;
+    }
+    if (i > 0) count = kept;
+  }
+  
+  // A route whose post or title changed after it was indexed waits for
+  // the update in progress rather than showing up for the wrong words
+  File postIndexFile = openFile(POST_INDEX_PATH, FILE_READ);
+  int resultCount = 0;
+  for (int i = 0; i < count && resultCount < maxResults; i++) {
+    int route = matches[i];
+    uint32_t indexed = 0;
+    if (route >= postMappingsCount || route >= (int)footer.routeCount) continue;
+    if (indexFile.seek(footer.fingerprintsOffset + route * sizeof(uint32_t)) &&
+        readFile(indexFile, &indexed, sizeof(indexed)) == sizeof(indexed) &&
+        indexed == routeFingerprint(postIndexFile, route)) {
+      results[resultCount++] = route;
+    }
+  }
+  if (postIndexFile) postIndexFile.close();
+  indexFile.close();
+  delete[] matches;
+  
+  matchCount = count;
+  return resultCount;
+}
+
+#endif // ENABLE_SEARCH && !SERVE_PREBUILT_SITE
+
+#endif // SEARCH_H
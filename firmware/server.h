@@ -12,6 +12,14 @@
 #include <SD.h>
 #include "config.h"
 #include "parser.h"
+#include "postindex.h"
+#include "routes.h"
+#include "renderer.h"
+#include "markdown.h"
+#include "pagecache.h"
+#include "search.h"
+#include "httpcache.h"
+#include "assets.h"
 #include "logger.h"
 
 // ============================================================================
@@ -20,9 +28,10 @@
 
 void setupRoutes();
 void serve404();
-void servePost(String filename, String title);
+void servePost(int route);
 void serveStaticFile(String path);
 void servePaginatedPosts(int page);
+bool servePrebuiltPage(const String& url);
 
 // ============================================================================
 // REQUEST ROUTING
@@ -32,12 +41,11 @@ void handleRequest() {
   String uri = server.uri();
   
   // Check redirections
-  for (int i = 0; i < redirectionsCount; i++) {
-    if (uri == redirections[i].fromPath) {
-      server.sendHeader("Location", redirections[i].toPath, true);
-      server.send(302, "text/plain", "");
-      return;
-    }
+  int redirect = findRedirection(uri);
+  if (redirect >= 0) {
+    server.sendHeader("Location", redirections[redirect].toPath(), true);
+    sendResponse(302, "text/plain", "");
+    return;
   }
   
   // Static files
@@ -46,18 +54,59 @@ void handleRequest() {
     return;
   }
   
+  #if SERVE_PREBUILT_SITE
+  // Every post and page was rendered by tools/build_site.py
+  if (servePrebuiltPage(uri)) {
+    return;
+  }
+  #else
   // Post mappings
-  for (int i = 0; i < postMappingsCount; i++) {
-    if (uri == postMappings[i].urlPath) {
-      servePost(postMappings[i].fileName, postMappings[i].title);
-      return;
-    }
+  int route = findPostMapping(uri);
+  if (route >= 0) {
+    servePost(route);
+    return;
   }
+  #endif
   
   // 404
   serve404();
 }
 
+// ============================================================================
+// PAGE VALIDATORS
+// ============================================================================
+
+// Rendered pages depend on the compiled templates and the route table, plus
+// whatever content the page itself shows; browsers revalidate them on every
+// view (no-cache) and get a 304 if nothing changed
+uint32_t pageVersion() {
+  return hashCombine(templateVersion, routesVersion);
+}
+
+time_t pageLastModified(time_t contentLastWrite) {
+  return max(contentLastWrite, max(templatesLastWrite, routesLastWrite));
+}
+
+bool sendPageValidators(uint32_t version, time_t lastModified) {
+  server.sendHeader("Cache-Control", "no-cache");
+  return sendValidators(makeETag(version), lastModified);
+}
+
+// ============================================================================
+// PREBUILT PAGES
+// ============================================================================
+
+// Streams the page tools/build_site.py rendered for url, revalidated on
+// every view like a page rendered here. Returns false, having sent
+// nothing, if the site has no such page.
+bool servePrebuiltPage(const String& url) {
+  #if SERVE_PREBUILT_SITE
+  return hasPrebuiltPage(url) && streamAsset(prebuiltPagePath(url), "text/html", "no-cache");
+  #else
+  return false;
+  #endif
+}
+
 // ============================================================================
 // PAGE HANDLERS
 // ============================================================================
@@ -75,171 +124,285 @@ void handlePaginatedPage() {
 }
 
 void servePaginatedPosts(int page) {
-  // Count blog posts
-  int totalBlogPosts = 0;
-  for (int i = 0; i < postMappingsCount; i++) {
-    if (postMappings[i].urlPath.startsWith("/posts/")) {
-      totalBlogPosts++;
-    }
+  #if SERVE_PREBUILT_SITE
+  if (page < 0 || !servePrebuiltPage(page == 0 ? String("/") : "/page?p=" + String(page))) {
+    serve404();
   }
+  return;
+  #endif
   
-  int startIdx = page * POSTS_PER_PAGE;
-  int totalPages = (totalBlogPosts + POSTS_PER_PAGE - 1) / POSTS_PER_PAGE;
-  
-  if (startIdx >= totalBlogPosts || page < 0) {
+  int totalPages = (blogPostCount + POSTS_PER_PAGE - 1) / POSTS_PER_PAGE;
+  if (page < 0 || page >= totalPages) {
     serve404();
     return;
   }
   
-  // Build posts HTML
-  String postsHtml = "";
-  int postsDisplayed = 0;
-  int postsSkipped = 0;
-  
-  for (int i = 0; i < postMappingsCount && postsDisplayed < POSTS_PER_PAGE; i++) {
-    if (!postMappings[i].urlPath.startsWith("/posts/")) {
-      continue;
-    }
-    
-    if (postsSkipped < startIdx) {
-      postsSkipped++;
-      continue;
-    }
-    
-    postsHtml += "<div class='post-preview'>";
-    postsHtml += "<h2><a href='" + postMappings[i].urlPath + "'>" + postMappings[i].title + "</a></h2>";
-    postsHtml += "<p>" + getPostPreview(postMappings[i].fileName) + "</p>";
-    postsHtml += "</div>";
-    
-    postsDisplayed++;
-  }
-  
-  // Build pagination HTML
-  String paginationHtml = "<div class='pagination'>";
-  if (page > 0) {
-    paginationHtml += "<a href='/page?p=" + String(page - 1) + "'>« Previous</a> ";
-  }
-  paginationHtml += "Page " + String(page + 1) + " of " + String(totalPages);
-  if (page < totalPages - 1) {
-    paginationHtml += " <a href='/page?p=" + String(page + 1) + "'>Next »</a>";
+  uint32_t version = hashCombine(hashCombine(pageVersion(), postIndexVersion), page);
+  if (sendPageValidators(version, pageLastModified(postIndexLastWrite))) {
+    return;
   }
-  paginationHtml += "</div>";
-  
-  // Load and populate template
-  String html = loadTemplate("home.html");
-  html.replace("{{TITLE}}", "My Blog - Home");
-  html.replace("{{POSTS}}", postsHtml);
-  html.replace("{{PAGINATION}}", paginationHtml);
   
   #if ENABLE_TRAFFIC_LOG
   logTraffic(200);
   #endif
   
-  server.send(200, "text/html", html);
+  if (serveCachedListingPage(page, version) || !beginChunkedPage(200)) {
+    return;
+  }
+  
+  // This page's posts are one slice of blogPosts[], and their previews
+  // come from the post index, one file for the whole page
+  int first = page * POSTS_PER_PAGE;
+  int last = min(first + POSTS_PER_PAGE, blogPostCount);
+  File indexFile = openFile(POST_INDEX_PATH, FILE_READ);
+  beginListingCapture(page);
+  renderTemplate(TEMPLATE_HOME, [&](TemplateVar var) {
+    if (var == VAR_TITLE) {
+      writeOutput("My Blog - Home");
+    } else if (var == VAR_POSTS) {
+      for (int n = first; n < last; n++) {
+        int i = blogPosts[n];
+        writeOutput("<div class='post-preview'>");
+        writeOutput("<h2><a href='");
+        writeOutput(postMappings[i].urlPath());
+        writeOutput("'>");
+        writeOutput(postMappings[i].title());
+        writeOutput("</a></h2>");
+        writeOutput("<p>" + readIndexedPreview(indexFile, i) + "</p>");
+        writeOutput("</div>");
+      }
+    } else if (var == VAR_PAGINATION) {
+      writeOutput("<div class='pagination'>");
+      if (page > 0) {
+        writeOutput("<a href='/page?p=" + String(page - 1) + "'>« Previous</a> ");
+      }
+      writeOutput("Page " + String(page + 1) + " of " + String(totalPages));
+      if (page < totalPages - 1) {
+        writeOutput(" <a href='/page?p=" + String(page + 1) + "'>Next »</a>");
+      }
+      writeOutput("</div>");
+    } else {
+      return false;
+    }
+    return true;
+  });
+  endChunkedPage();
+  endListingCapture(page, version);
+  
+  if (indexFile) indexFile.close();
 }
 
 void handleArchive() {
-  int postCount = 0;
-  for (int i = 0; i < postMappingsCount; i++) {
-    if (postMappings[i].urlPath.startsWith("/posts/")) {
-      postCount++;
-    }
+  #if SERVE_PREBUILT_SITE
+  if (!servePrebuiltPage("/archive")) {
+    serve404();
   }
+  return;
+  #endif
   
-  String postListHtml = "";
-  for (int i = 0; i < postMappingsCount; i++) {
-    if (postMappings[i].urlPath.startsWith("/posts/")) {
-      postListHtml += "<li><a href='" + postMappings[i].urlPath + "'>" + postMappings[i].title + "</a></li>";
-    }
+  uint32_t version = pageVersion();
+  if (sendPageValidators(version, pageLastModified(0))) {
+    return;
   }
   
-  String html = loadTemplate("archive.html");
-  html.replace("{{TITLE}}", "Archive - All Posts");
-  html.replace("{{POST_COUNT}}", String(postCount));
-  html.replace("{{POST_LIST}}", postListHtml);
-  
   #if ENABLE_TRAFFIC_LOG
   logTraffic(200);
   #endif
   
-  server.send(200, "text/html", html);
+  if (serveCachedListingPage(LISTING_ARCHIVE, version) || !beginChunkedPage(200)) {
+    return;
+  }
+  beginListingCapture(LISTING_ARCHIVE);
+  renderTemplate(TEMPLATE_ARCHIVE, [&](TemplateVar var) {
+    if (var == VAR_TITLE) {
+      writeOutput("Archive - All Posts");
+    } else if (var == VAR_POST_COUNT) {
+      writeOutput(String(blogPostCount));
+    } else if (var == VAR_POST_LIST) {
+      for (int n = 0; n < blogPostCount; n++) {
+        const PostMapping& mapping = postMappings[blogPosts[n]];
+        writeOutput("<li><a href='");
+        writeOutput(mapping.urlPath());
+        writeOutput("'>");
+        writeOutput(mapping.title());
+        writeOutput("</a></li>");
+      }
+    } else {
+      return false;
+    }
+    return true;
+  });
+  endChunkedPage();
+  endListingCapture(LISTING_ARCHIVE, version);
 }
 
 // ============================================================================
-// POST SERVING
+// SEARCH
 // ============================================================================
 
-void servePost(String filename, String title) {
-  File postFile = SD.open("/posts/" + filename, FILE_READ);
-  if (!postFile) {
-    serve404();
+#if ENABLE_SEARCH && !SERVE_PREBUILT_SITE
+const unsigned int SEARCH_MAX_QUERY_LENGTH = 100;
+
+void writeSearchResults(const String& query, const uint16_t* results, int resultCount, int matchCount) {
+  if (query.length() == 0) return;
+  
+  writeOutput("<p class='search-summary'>");
+  if (matchCount == 0) {
+    writeOutput("No posts match <strong>");
+  } else {
+    writeOutput(String(matchCount) + (matchCount == 1 ? " post matches" : " posts match") + " <strong>");
+  }
+  writeEscaped(query.c_str(), query.length());
+  writeOutput("</strong>");
+  if (resultCount < matchCount) {
+    writeOutput(", showing the first " + String(resultCount));
+  }
+  writeOutput(".</p>");
+  
+  // Previews come from the post index, as on the listing pages
+  File indexFile = openFile(POST_INDEX_PATH, FILE_READ);
+  for (int n = 0; n < resultCount; n++) {
+    int i = results[n];
+    writeOutput("<div class='post-preview'>");
+    writeOutput("<h2><a href='");
+    writeOutput(postMappings[i].urlPath());
+    writeOutput("'>");
+    writeOutput(postMappings[i].title());
+    writeOutput("</a></h2>");
+    writeOutput("<p>" + readIndexedPreview(indexFile, i) + "</p>");
+    writeOutput("</div>");
+  }
+  if (indexFile) indexFile.close();
+  
+  if (isSearchIndexUpdating()) {
+    writeOutput("<p class='search-summary'>The search index is being updated; recent changes may not show up yet.</p>");
+  }
+}
+
+void handleSearch() {
+  if (compiledTemplates[TEMPLATE_SEARCH].segmentCount == 0) {
+    sendResponse(500, "text/plain", "Search needs /templates/search.html");
     return;
   }
   
-  // Read and escape HTML
-  String content = "";
-  while (postFile.available()) {
-    char c = postFile.read();
-    if (c == '<') content += "&lt;";
-    else if (c == '>') content += "&gt;";
-    else if (c == '&') content += "&amp;";
-    else content += c;
+  String query = server.arg("q");
+  query.trim();
+  if (query.length() > SEARCH_MAX_QUERY_LENGTH) {
+    query = query.substring(0, SEARCH_MAX_QUERY_LENGTH);
   }
-  postFile.close();
   
-  // Load and populate template
-  String html = loadTemplate("post.html");
-  html.replace("{{TITLE}}", title);
-  html.replace("{{POST_TITLE}}", title);
-  html.replace("{{CONTENT}}", content);
+  uint16_t results[SEARCH_MAX_RESULTS];
+  int matchCount = 0;
+  int resultCount = searchPosts(query, results, SEARCH_MAX_RESULTS, matchCount);
   
   #if ENABLE_TRAFFIC_LOG
   logTraffic(200);
   #endif
   
-  server.send(200, "text/html", html);
+  // Results change whenever the index does; nothing here is worth caching
+  server.sendHeader("Cache-Control", "no-cache");
+  if (!beginChunkedPage(200)) {
+    return;
+  }
+  renderTemplate(TEMPLATE_SEARCH, [&](TemplateVar var) {
+    if (var == VAR_TITLE) {
+      writeOutput("Search");
+      if (query.length() > 0) {
+        writeOutput(" - ");
+        writeEscaped(query.c_str(), query.length());
+      }
+    } else if (var == VAR_QUERY) {
+      writeEscaped(query.c_str(), query.length());
+    } else if (var == VAR_RESULTS) {
+      writeSearchResults(query, results, resultCount, matchCount);
+    } else {
+      return false;
+    }
+    return true;
+  });
+  endChunkedPage();
 }
+#endif
 
 // ============================================================================
-// STATIC FILE SERVING
+// POST SERVING
 // ============================================================================
 
-void serveStaticFile(String path) {
-  File file = SD.open(path, FILE_READ);
-  if (!file) {
-    serve404();
-    return;
+void servePost(int route) {
+  const PostMapping& mapping = postMappings[route];
+  String cachePath = pageCachePath(mapping);
+  
+  // The post index keeps each post's size and mtime in RAM, so a repeat
+  // view costs a single open: the cached page, or none for a 304
+  PostStamp stamp;
+  if (findPostStamp(route, stamp)) {
+    uint32_t version = hashCombine(hashCombine(pageVersion(), stamp.fileSize), stamp.lastWrite);
+    if (sendPageValidators(hashCombine(version, hashString(mapping.fileName())), pageLastModified(stamp.lastWrite))) {
+      return;
+    }
   }
   
-  size_t fileSize = file.size();
-  if (fileSize > 200000) {
-    Serial.println("WARNING: Serving large file (" + String(fileSize) + " bytes): " + path);
+  // Served straight from the page cache once rendered
+  File cachedPage = openFile(cachePath, FILE_READ);
+  if (cachedPage) {
+    #if ENABLE_TRAFFIC_LOG
+    logTraffic(200);
+    #endif
+    streamFileResponse(cachedPage, "text/html");
+    cachedPage.close();
+    return;
   }
   
-  String contentType = getContentType(path);
-  server.sendHeader("Cache-Control", "max-age=86400");
+  File postFile = openFile(String("/posts/") + mapping.fileName(), FILE_READ);
+  if (!postFile) {
+    serve404();
+    return;
+  }
   
   #if ENABLE_TRAFFIC_LOG
   logTraffic(200);
   #endif
   
-  server.streamFile(file, contentType);
-  file.close();
+  if (!beginChunkedPage(200)) {
+    postFile.close();
+    return;
+  }
+  
+  // Markdown is rendered to HTML as it is read, never held in RAM, and
+  // captured into the page cache on the way out
+  beginPageCapture(cachePath);
+  renderTemplate(TEMPLATE_POST, [&](TemplateVar var) {
+    if (var == VAR_TITLE || var == VAR_POST_TITLE) {
+      writeOutput(mapping.title());
+    } else if (var == VAR_CONTENT) {
+      renderMarkdown(postFile);
+    } else {
+      return false;
+    }
+    return true;
+  });
+  endChunkedPage();
+  endPageCapture(cachePath);
+  
+  postFile.close();
+}
+
+// ============================================================================
+// STATIC FILE SERVING
+// ============================================================================
+
+void serveStaticFile(String path) {
+  if (!streamAsset(path, getContentType(path), "max-age=86400")) {
+    serve404();
+  }
 }
 
 void handleCSS() {
-  File cssFile = SD.open("/static/style.css", FILE_READ);
-  if (cssFile) {
-    #if ENABLE_TRAFFIC_LOG
-    logTraffic(200);
-    #endif
-    server.streamFile(cssFile, "text/css");
-    cssFile.close();
-  } else {
+  if (!streamAsset("/static/style.css", "text/css")) {
     #if ENABLE_TRAFFIC_LOG
     logTraffic(404);
     #endif
-    server.send(404, "text/plain", "CSS file not found");
+    sendResponse(404, "text/plain", "CSS file not found");
   }
 }
 
@@ -252,8 +415,20 @@ void serve404() {
   logTraffic(404);
   #endif
   
-  String html = loadTemplate("404.html");
-  server.send(404, "text/html", html);
+  #if SERVE_PREBUILT_SITE
+  File page = openFile(SITE_DIR "/404.htm", FILE_READ);
+  if (page) {
+    streamFileResponse(page, "text/html", 404);
+    page.close();
+  } else {
+    sendResponse(404, "text/plain", "Not found");
+  }
+  #else
+  if (beginChunkedPage(404)) {
+    renderTemplate(TEMPLATE_404, [](TemplateVar var) { return false; });
+    endChunkedPage();
+  }
+  #endif
 }
 
 #endif // SERVER_H
@@ -0,0 +1,244 @@
+/*
+ * stats.h - Traffic Statistics
+ *
+ * Running totals kept alongside the access log: hits per route, counts per
+ * status code, the most requested missing paths and the busiest user
+ * agents, and requests per hour over the last day. Everything lives in
+ * fixed-size tables, so memory use doesn't grow with traffic, and is
+ * checkpointed to the SD card so a reboot doesn't lose it.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "config.h"
+#include "parser.h"
+#include "routes.h"
+
+#if ENABLE_TRAFFIC_STATS
+
+#define STATS_PATH "/logs/stats.bin"
+#define STATS_TEMP_PATH "/logs/stats.tmp"
+#define STATS_FILE_MAGIC 0x31545453UL  // "STS1"
+
+// Requests that don't resolve to an entry in routes.txt
+enum BuiltinRoute {
+  ROUTE_HOME,      // / and /page
+  ROUTE_ARCHIVE,
+  ROUTE_STATIC,    // /static/* and /style.css
+  ROUTE_OTHER,     // Redirects and unknown paths
+  BUILTIN_ROUTE_COUNT
+};
+
+// Approximate top-K by the Space-Saving algorithm: a new key takes over the
+// least counted slot and inherits its count as error, so a key's true count
+// lies between count - error and count
+struct TopKEntry {
+  uint32_t hash;
+  uint32_t count;     // 0 = empty slot
+  uint32_t error;
+  char label[STATS_LABEL_SIZE];
+};
+
+struct StatusCount {
+  uint16_t status;    // 0 = empty slot
+  uint32_t count;
+};
+
+// Everything except per-route hits, checkpointed as one block
+struct TrafficStats {
+  uint32_t totalRequests;
+  uint32_t since;                        // Epoch time counting began, 0 if unknown
+  uint32_t builtinHits[BUILTIN_ROUTE_COUNT];
+  StatusCount statuses[STATS_STATUS_SLOTS];
+  uint32_t otherStatuses;                // Codes that found no free slot
+  TopKEntry missingPaths[STATS_TOP_K];
+  TopKEntry userAgents[STATS_TOP_K];
+  uint32_t hourly[24];                   // Ring indexed by epoch hour % 24
+  uint32_t currentHour;                  // Epoch hour of the newest bucket
+};
+
+// Written before the stats; the route hits follow them
+struct StatsFileHeader {
+  uint32_t magic;
+  uint32_t statsSize;        // sizeof(TrafficStats), to reject other layouts
+  uint32_t routesVersion;    // Route hits are only valid for the same routes
+  uint32_t routeCount;
+};
+
+TrafficStats trafficStats;
+
+// Hits by postMappings[] index, resized when the route table changes
+uint32_t* routeHits = nullptr;
+int routeHitsCount = 0;
+uint32_t routeHitsVersion = 0;
+
+bool statsDirty = false;
+unsigned long statsLastCheckpoint = 0;
+
+// ============================================================================
+// COUNTING
+// ============================================================================
+
+// Route indices change whenever routes.txt does, so old counts are dropped
+void matchRouteHits() {
+  if (routeHits != nullptr && routeHitsVersion == routesVersion && routeHitsCount == postMappingsCount) {
+    return;
+  }
+  delete[] routeHits;
+  routeHitsCount = postMappingsCount;
+  routeHits = new uint32_t[max(routeHitsCount, 1)]();
+  routeHitsVersion = routesVersion;
+}
+
+int builtinRoute(const String& uri) {
+  if (uri == "/" || uri == "/page") return ROUTE_HOME;
+  if (uri == "/archive") return ROUTE_ARCHIVE;
+  if (uri.startsWith("/static/") || uri == "/style.css") return ROUTE_STATIC;
+  return ROUTE_OTHER;
+}
+
+void addToTopK(TopKEntry* entries, const char* key) {
+  uint32_t hash = hashString(key);
+  TopKEntry* least = &entries[0];
+  
+  for (int i = 0; i < STATS_TOP_K; i++) {
+    if (entries[i].count > 0 && entries[i].hash == hash) {
+      entries[i].count++;
+      return;
+    }
+    if (entries[i].count < least->count) {
+      least = &entries[i];
+    }
+  }
+  
+  // An empty slot has count 0, so it is taken before anything is evicted
+  least->error = least->count;
+  least->count++;
+  least->hash = hash;
+  snprintf(least->label, sizeof(least->label), "%s", key);
+}
+
+void addStatus(int status) {
+  for (int i = 0; i < STATS_STATUS_SLOTS; i++) {
+    StatusCount& slot = trafficStats.statuses[i];
+    if (slot.status == status || slot.status == 0) {
+      slot.status = status;
+      slot.count++;
+      return;
+    }
+  }
+  trafficStats.otherStatuses++;
+}
+
+// Only wall-clock time is bucketed; before NTP sync there is no hour to use
+void addToHour(uint32_t epochSeconds) {
+  uint32_t hour = epochSeconds / 3600;
+  if (hour > trafficStats.currentHour) {
+    // Clear the buckets of the hours that passed without traffic
+    uint32_t elapsed = min(hour - trafficStats.currentHour, (uint32_t)24);
+    for (uint32_t i = 1; i <= elapsed; i++) {
+      trafficStats.hourly[(trafficStats.currentHour + i) % 24] = 0;
+    }
+    trafficStats.currentHour = hour;
+  }
+  trafficStats.hourly[trafficStats.currentHour % 24]++;
+}
+
+// Called from logTraffic() for every request
+void recordTrafficStats(const String& uri, int status, const char* userAgent, uint32_t seconds, bool uptime) {
+  trafficStats.totalRequests++;
+  if (!uptime) {
+    if (trafficStats.since == 0) trafficStats.since = seconds;
+    addToHour(seconds);
+  }
+  
+  matchRouteHits();
+  int route = findPostMapping(uri);
+  if (route >= 0) {
+    routeHits[route]++;
+  } else {
+    trafficStats.builtinHits[builtinRoute(uri)]++;
+  }
+  
+  addStatus(status);
+  if (status == 404) {
+    addToTopK(trafficStats.missingPaths, uri.c_str());
+  }
+  addToTopK(trafficStats.userAgents, userAgent);
+  
+  statsDirty = true;
+}
+
+// ============================================================================
+// CHECKPOINTS
+// ============================================================================
+
+// Written to a temporary file and renamed, so a reset mid-write leaves the
+// previous checkpoint intact
+void saveTrafficStats() {
+  SD.remove(STATS_TEMP_PATH);
+  File statsFile = openFile(STATS_TEMP_PATH, FILE_WRITE);
+  if (!statsFile) {
+    Serial.println("ERROR: Could not write " STATS_TEMP_PATH);
+    return;
+  }
+  
+  matchRouteHits();
+  StatsFileHeader header = { STATS_FILE_MAGIC, sizeof(TrafficStats), routeHitsVersion, (uint32_t)routeHitsCount };
+  size_t expected = sizeof(header) + sizeof(trafficStats) + routeHitsCount * sizeof(uint32_t);
+  size_t written = writeFile(statsFile, &header, sizeof(header));
+  written += writeFile(statsFile, &trafficStats, sizeof(trafficStats));
+  written += writeFile(statsFile, routeHits, routeHitsCount * sizeof(uint32_t));
+  statsFile.close();
+  
+  if (written != expected) {
+    Serial.println("ERROR: Short write to " STATS_TEMP_PATH);
+    SD.remove(STATS_TEMP_PATH);
+    return;
+  }
+  SD.remove(STATS_PATH);
+  SD.rename(STATS_TEMP_PATH, STATS_PATH);
+  statsDirty = false;
+}
+
+// Called once at boot, after the routes are loaded
+void loadTrafficStats() {
+  memset(&trafficStats, 0, sizeof(trafficStats));
+  matchRouteHits();
+  statsLastCheckpoint = millis();
+  
+  File statsFile = openFile(STATS_PATH, FILE_READ);
+  if (!statsFile) {
+    return;
+  }
+  
+  StatsFileHeader header;
+  bool valid = readFile(statsFile, &header, sizeof(header)) == sizeof(header) &&
+               header.magic == STATS_FILE_MAGIC && header.statsSize == sizeof(TrafficStats) &&
+               readFile(statsFile, &trafficStats, sizeof(trafficStats)) == sizeof(trafficStats);
+  if (!valid) {
+    Serial.println("Ignoring unreadable " STATS_PATH);
+    memset(&trafficStats, 0, sizeof(trafficStats));
+  } else if (header.routesVersion == routeHitsVersion && header.routeCount == (uint32_t)routeHitsCount) {
+    readFile(statsFile, routeHits, routeHitsCount * sizeof(uint32_t));
+  }
+  statsFile.close();
+  
+  Serial.printf("Restored stats for %lu requests\n", (unsigned long)trafficStats.totalRequests);
+}
+
+// Call from loop(): checkpoints at most every STATS_CHECKPOINT_MS, and only
+// if something was counted since the last one
+void serviceTrafficStats() {
+  if (statsDirty && millis() - statsLastCheckpoint > STATS_CHECKPOINT_MS) {
+    saveTrafficStats();
+    statsLastCheckpoint = millis();
+  }
+}
+
+#endif // ENABLE_TRAFFIC_STATS
+
+#endif // STATS_H
@@ -0,0 +1,242 @@
+/*
+ * storage.h - Buffered SD Card I/O
+ *
+ * Block-based file reading and writing, so callers don't pay SPI/FAT
+ * overhead for every single byte, and counters of all SD card activity
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+// Matches the SD card sector size; reads from offset 0 stay sector-aligned
+const size_t SD_BLOCK_SIZE = 512;
+
+// ============================================================================
+// I/O ACCOUNTING
+// ============================================================================
+
+// SD card activity since boot, reported by /admin/metrics. Modules open,
+// read and write files through the helpers below so nothing is missed.
+struct SdCounters {
+  uint32_t opens;
+  uint64_t bytesRead;
+  uint64_t bytesWritten;
+};
+
+SdCounters sdCounters = { 0, 0, 0 };
+
+File openFile(const String& path, int mode = FILE_READ) {
+  sdCounters.opens++;
+  return SD.open(path, mode);
+}
+
+int readFile(File& file, void* dest, size_t count) {
+  int bytesRead = file.read((uint8_t*)dest, count);
+  if (bytesRead > 0) sdCounters.bytesRead += bytesRead;
+  return bytesRead;
+}
+
+size_t writeFile(File& file, const void* data, size_t count) {
+  size_t written = file.write((const uint8_t*)data, count);
+  sdCounters.bytesWritten += written;
+  return written;
+}
+
+// ============================================================================
+// BUFFERED READER
+// ============================================================================
+
+class BufferedReader {
+ public:
+  explicit BufferedReader(File& file) : file(file), position(0), length(0) {}
+  
+  // Next byte, or -1 at end of file
+  int read() {
+    if (position == length && !fill()) return -1;
+    return buffer[position++];
+  }
+  
+  int peek() {
+    if (position == length && !fill()) return -1;
+    return buffer[position];
+  }
+  
+  size_t read(uint8_t* dest, size_t count) {
+    size_t copied = 0;
+    while (copied < count) {
+      if (position == length && !fill()) break;
+      size_t n = length - position;
+      if (n > count - copied) n = count - copied;
+      memcpy(dest + copied, buffer + position, n);
+      position += n;
+      copied += n;
+    }
+    return copied;
+  }
+  
+  // Reads one line into a caller-owned buffer without allocating. The line
+  // ending is stripped and overlong lines are truncated to maxLength - 1.
+  // Returns false once there are no more lines.
+  bool readLine(char* line, size_t maxLength, size_t* lineLength = nullptr) {
+    size_t n = 0;
+    int c = read();
+    if (c < 0) return false;
+    
+    while (c >= 0 && c != '\n') {
+      if (n < maxLength - 1) line[n++] = (char)c;
+      c = read();
+    }
+    if (n > 0 && line[n - 1] == '\r') n--;
+    
+    line[n] = '\0';
+    if (lineLength) *lineLength = n;
+    return true;
+  }
+  
+  // Like readLine, but an overlong line is returned in pieces: complete is
+  // false until the piece that ends the line has been read
+  bool readLinePart(char* line, size_t maxLength, size_t* lineLength, bool* complete) {
+    size_t n = 0;
+    int c = peek();
+    if (c < 0) return false;
+    
+    *complete = false;
+    while (n < maxLength - 1) {
+      c = read();
+      if (c < 0 || c == '\n') {
+        *complete = true;
+        break;
+      }
+      line[n++] = (char)c;
+    }
+    if (!*complete && peek() < 0) *complete = true;
+    if (*complete && n > 0 && line[n - 1] == '\r') n--;
+    
+    line[n] = '\0';
+    *lineLength = n;
+    return true;
+  }
+  
+  // Rest of the file as a String, allocated once up front
+  String readString() {
+    String content;
+    content.reserve(file.size() - file.position() + (length - position));
+    while (position < length || fill()) {
+      content.concat((const char*)buffer + position, length - position);
+      position = length;
+    }
+    return content;
+  }
+  
+ private:
+  bool fill() {
+    int bytesRead = readFile(file, buffer, SD_BLOCK_SIZE);
+    position = 0;
+    length = (bytesRead > 0) ? bytesRead : 0;
+    return length > 0;
+  }
+  
+  File& file;
+  uint8_t buffer[SD_BLOCK_SIZE];
+  size_t position;
+  size_t length;
+};
+
+// ============================================================================
+// BUFFERED WRITER
+// ============================================================================
+
+class BufferedWriter {
+ public:
+  explicit BufferedWriter(File& file) : file(file), length(0), written(0) {}
+  ~BufferedWriter() { flush(); }
+  
+  size_t write(const uint8_t* data, size_t count) {
+    size_t remaining = count;
+    while (remaining > 0) {
+      size_t n = SD_BLOCK_SIZE - length;
+      if (n > remaining) n = remaining;
+      memcpy(buffer + length, data, n);
+      length += n;
+      data += n;
+      remaining -= n;
+      if (length == SD_BLOCK_SIZE) flush();
+    }
+    return count;
+  }
+  
+  size_t write(uint8_t c) {
+    return write(&c, 1);
+  }
+  
+  size_t print(const String& text) {
+    return write((const uint8_t*)text.c_str(), text.length());
+  }
+  
+  size_t print(const char* text) {
+    return write((const uint8_t*)text, strlen(text));
+  }
+  
+  void flush() {
+    if (length > 0) {
+      written += writeFile(file, buffer, length);
+      length = 0;
+    }
+  }
+  
+  // Bytes that have actually reached the file
+  size_t bytesWritten() const {
+    return written;
+  }
+  
+ private:
+  File& file;
+  uint8_t buffer[SD_BLOCK_SIZE];
+  size_t length;
+  size_t written;
+};
+
+// ============================================================================
+// FILE HELPERS
+// ============================================================================
+
+time_t getFileLastWrite(const String& path) {
+  File file = openFile(path, FILE_READ);
+  if (!file) return 0;
+  time_t lastWrite = file.getLastWrite();
+  file.close();
+  return lastWrite;
+}
+
+size_t getFileSize(const String& path) {
+  File file = openFile(path, FILE_READ);
+  if (!file) return 0;
+  size_t size = file.size();
+  file.close();
+  return size;
+}
+
+String readFileToString(File& file) {
+  BufferedReader reader(file);
+  return reader.readString();
+}
+
+// Copies the remainder of one file into another, one block at a time
+size_t copyFile(File& from, File& to) {
+  uint8_t block[SD_BLOCK_SIZE];
+  size_t total = 0;
+  
+  while (true) {
+    int bytesRead = readFile(from, block, sizeof(block));
+    if (bytesRead <= 0) break;
+    total += writeFile(to, block, bytesRead);
+    yield();
+  }
+  
+  return total;
+}
+
+#endif // STORAGE_H
@@ -0,0 +1,264 @@
+/*
+ * Arduino.h - Host Stand-In for the Arduino Core
+ *
+ * Just enough of the ESP8266 Arduino API for the firmware headers to
+ * compile and run on Linux: String, Print/Stream, Serial, timing, GPIO
+ * no-ops and an ESP object that reports a simulated heap (see heap.cpp).
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <strings.h>
+
+typedef uint8_t byte;
+
+using std::max;
+using std::min;
+
+#define F(text) (text)
+#define PROGMEM
+#define PSTR(text) (text)
+#define FPSTR(text) (text)
+
+#define HEX 16
+#define DEC 10
+
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+
+// Wemos D1 mini pin numbers, as used in config.h
+#define D4 2
+#define D8 15
+#define LED_BUILTIN 2
+
+// ============================================================================
+// TIMING AND GPIO
+// ============================================================================
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+inline void yield() {}
+
+inline void pinMode(int pin, int mode) {}
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+
+// ============================================================================
+// STRING
+// ============================================================================
+
+class String {
+ public:
+  String() {}
+  String(const char* text) { if (text) value = text; }
+  String(const std::string& text) : value(text) {}
+  explicit String(char c) : value(1, c) {}
+  String(int number, unsigned char base = DEC) { format(base == HEX ? "%x" : "%d", number); }
+  String(unsigned int number, unsigned char base = DEC) { format(base == HEX ? "%x" : "%u", number); }
+  String(long number, unsigned char base = DEC) { format(base == HEX ? "%lx" : "%ld", number); }
+  String(unsigned long number, unsigned char base = DEC) { format(base == HEX ? "%lx" : "%lu", number); }
+  String(long long number) { value = std::to_string(number); }
+  String(unsigned long long number) { value = std::to_string(number); }
+  String(float number, unsigned char decimals = 2) { format("%.*f", (int)decimals, (double)number); }
+  String(double number, unsigned char decimals = 2) { format("%.*f", (int)decimals, number); }
+
+  unsigned int length() const { return value.size(); }
+  const char* c_str() const { return value.c_str(); }
+  bool isEmpty() const { return value.empty(); }
+  bool reserve(unsigned int size) { value.reserve(size); return true; }
+  void clear() { value.clear(); }
+
+  char operator[](unsigned int i) const { return i < value.size() ? value[i] : 0; }
+  char& operator[](unsigned int i) { return value[i]; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+  void setCharAt(unsigned int i, char c) { if (i < value.size()) value[i] = c; }
+
+  bool concat(const String& text) { value += text.value; return true; }
+  bool concat(const char* text) { if (text) value += text; return true; }
+  bool concat(const char* text, unsigned int length) { value.append(text, length); return true; }
+  bool concat(char c) { value += c; return true; }
+  bool concat(int number) { return concat(String(number)); }
+  bool concat(unsigned int number) { return concat(String(number)); }
+  bool concat(long number) { return concat(String(number)); }
+  bool concat(unsigned long number) { return concat(String(number)); }
+
+  template <typename T>
+  String& operator+=(const T& other) { concat(other); return *this; }
+
+  bool equals(const String& other) const { return value == other.value; }
+  bool equalsIgnoreCase(const String& other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+  bool operator==(const String& other) const { return value == other.value; }
+  bool operator==(const char* other) const { return value == (other ? other : ""); }
+  bool operator!=(const String& other) const { return !(*this == other); }
+  bool operator!=(const char* other) const { return !(*this == other); }
+  bool operator<(const String& other) const { return value < other.value; }
+
+  bool startsWith(const String& prefix) const { return value.compare(0, prefix.value.size(), prefix.value) == 0; }
+  bool startsWith(const String& prefix, unsigned int offset) const {
+    return offset <= value.size() && value.compare(offset, prefix.value.size(), prefix.value) == 0;
+  }
+  bool endsWith(const String& suffix) const {
+    return value.size() >= suffix.value.size() &&
+           value.compare(value.size() - suffix.value.size(), suffix.value.size(), suffix.value) == 0;
+  }
+
+  int indexOf(char c, unsigned int from = 0) const { return position(value.find(c, from)); }
+  int indexOf(const String& text, unsigned int from = 0) const { return position(value.find(text.value, from)); }
+  int lastIndexOf(char c) const { return position(value.rfind(c)); }
+  int lastIndexOf(char c, unsigned int from) const { return position(value.rfind(c, from)); }
+  int lastIndexOf(const String& text) const { return position(value.rfind(text.value)); }
+
+  String substring(unsigned int from) const { return from < value.size() ? String(value.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= value.size()) return String();
+    return String(value.substr(from, std::min<size_t>(to, value.size()) - from));
+  }
+
+  void replace(char from, char to) { std::replace(value.begin(), value.end(), from, to); }
+  void replace(const String& from, const String& to) {
+    if (from.value.empty()) return;
+    for (size_t i = value.find(from.value); i != std::string::npos; i = value.find(from.value, i + to.value.size())) {
+      value.replace(i, from.value.size(), to.value);
+    }
+  }
+  void remove(unsigned int index) { if (index < value.size()) value.erase(index); }
+  void remove(unsigned int index, unsigned int count) { if (index < value.size()) value.erase(index, count); }
+  void toLowerCase() { for (char& c : value) c = tolower((unsigned char)c); }
+  void toUpperCase() { for (char& c : value) c = toupper((unsigned char)c); }
+  void trim() {
+    size_t start = value.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) {
+      value.clear();
+      return;
+    }
+    value = value.substr(start, value.find_last_not_of(" \t\r\n") - start + 1);
+  }
+
+  long toInt() const { return atol(value.c_str()); }
+  float toFloat() const { return atof(value.c_str()); }
+
+  friend String operator+(const String& a, const String& b) { return String(a.value + b.value); }
+  friend String operator+(const String& a, const char* b) { return String(a.value + b); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.value); }
+  friend String operator+(const String& a, char b) { return String(a.value + b); }
+  friend String operator+(const String& a, int b) { return a + String(b); }
+  friend String operator+(const String& a, unsigned int b) { return a + String(b); }
+  friend String operator+(const String& a, long b) { return a + String(b); }
+  friend String operator+(const String& a, unsigned long b) { return a + String(b); }
+
+ private:
+  static int position(size_t index) { return index == std::string::npos ? -1 : (int)index; }
+
+  void format(const char* pattern, ...) {
+    char text[64];
+    va_list args;
+    va_start(args, pattern);
+    vsnprintf(text, sizeof(text), pattern, args);
+    va_end(args);
+    value = text;
+  }
+
+  std::string value;
+};
+
+extern const String emptyString;
+
+// ============================================================================
+// PRINT AND STREAM
+// ============================================================================
+
+class Print;
+
+class Printable {
+ public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& out) const = 0;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t* data, size_t length) = 0;
+  virtual size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const char* data, size_t length) { return write((const uint8_t*)data, length); }
+  size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+  virtual void flush() {}
+
+  size_t print(const String& text) { return write((const uint8_t*)text.c_str(), text.length()); }
+  size_t print(const char* text) { return write(text); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int number) { return print(String(number)); }
+  size_t print(unsigned int number) { return print(String(number)); }
+  size_t print(long number) { return print(String(number)); }
+  size_t print(unsigned long number) { return print(String(number)); }
+  size_t print(double number, int decimals = 2) { return print(String(number, decimals)); }
+  size_t print(const Printable& item) { return item.printTo(*this); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& item) { return print(item) + println(); }
+
+  size_t printf(const char* pattern, ...) __attribute__((format(printf, 2, 3))) {
+    char text[512];
+    va_list args;
+    va_start(args, pattern);
+    int length = vsnprintf(text, sizeof(text), pattern, args);
+    va_end(args);
+    return write((const uint8_t*)text, std::min(length, (int)sizeof(text) - 1));
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+// Writes to stderr, so stdout stays free for tools; --quiet silences it
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long baud) {}
+  size_t write(const uint8_t* data, size_t length) override;
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+  bool enabled = true;
+};
+
+extern HardwareSerial Serial;
+
+// ============================================================================
+// SIMULATED HEAP
+// ============================================================================
+
+// Every operator new on the host is counted against a heap of the size the
+// ESP8266 has free after boot; see heap.cpp
+class EspClass {
+ public:
+  uint32_t getFreeHeap();
+  uint32_t getMaxFreeBlockSize() { return getFreeHeap(); }
+  uint8_t getHeapFragmentation() { return 0; }
+  uint32_t getCycleCount() { return micros() * 80; }
+  void restart() { exit(0); }
+};
+
+extern EspClass ESP;
+
+#endif // HOST_ARDUINO_H
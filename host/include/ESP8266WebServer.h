@@ -0,0 +1,163 @@
+/*
+ * ESP8266WebServer.h - Host Stand-In for the ESP8266 Web Server
+ *
+ * A real HTTP/1.1 server on a Linux socket with the same interface and the
+ * same one-connection-at-a-time behaviour as the ESP8266 core's server:
+ * routes, hooks, query and form arguments, multipart uploads, keep-alive,
+ * chunked responses and streamFile().
+ */
+
+#ifndef HOST_ESP8266WEBSERVER_H
+#define HOST_ESP8266WEBSERVER_H
+
+#include <vector>
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+
+#define HTTP_UPLOAD_BUFLEN 2048
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+struct HTTPUpload {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  size_t contentLength;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+class ESP8266WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::function<String(const String&)> ContentTypeFunction;
+
+  enum ClientFuture { CLIENT_REQUEST_CAN_CONTINUE, CLIENT_REQUEST_IS_HANDLED, CLIENT_MUST_STOP, CLIENT_IS_GIVEN };
+  typedef std::function<ClientFuture(const String& method, const String& url, WiFiClient* client,
+                                     ContentTypeFunction contentType)> HookFunction;
+
+  explicit ESP8266WebServer(int port = 80) : port(port) {}
+
+  void begin();
+  void close();
+  void handleClient();
+
+  void on(const String& uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+  void on(const String& uri, HTTPMethod method, THandlerFunction handler) { on(uri, method, handler, nullptr); }
+  void on(const String& uri, HTTPMethod method, THandlerFunction handler, THandlerFunction uploadHandler);
+  void onNotFound(THandlerFunction handler) { notFoundHandler = handler; }
+  void addHook(HookFunction hook) { hooks.push_back(hook); }
+
+  // Every request header is kept on the host, so this only documents intent
+  template <typename... Names>
+  void collectHeaders(const Names&... names) {}
+
+  String uri() const { return requestUri; }
+  HTTPMethod method() const { return requestMethod; }
+  WiFiClient& client() { return currentClient; }
+  HTTPUpload& upload() { return currentUpload; }
+
+  int args() const { return argNames.size(); }
+  String argName(int i) const { return argNames[i]; }
+  String arg(int i) const { return argValues[i]; }
+  String arg(const String& name) const;
+  bool hasArg(const String& name) const;
+
+  int headers() const { return headerNames.size(); }
+  String header(const String& name) const;
+  bool hasHeader(const String& name) const;
+
+  void keepAlive(bool enabled) { keepAliveEnabled = enabled; }
+  void setContentLength(size_t length) { contentLength = length; }
+  void sendHeader(const String& name, const String& value, bool first = false);
+
+  void send(int code, const char* contentType = nullptr, const String& content = emptyString);
+  void send(int code, const String& contentType, const String& content) { send(code, contentType.c_str(), content); }
+  void send(int code, const char* contentType, const char* content) { send(code, contentType, String(content)); }
+  void sendContent(const String& content) { sendContent(content.c_str(), content.length()); }
+  void sendContent(const char* content, size_t length);
+
+  // Sends only the headers for HEAD. A .gz file sent under another type
+  // gets Content-Encoding: gzip, as on the device.
+  template <typename T>
+  size_t streamFile(T& file, const String& contentType, HTTPMethod method, int code = 200) {
+    if (String(file.name()).endsWith(".gz") && contentType != "application/x-gzip" &&
+        contentType != "application/octet-stream") {
+      sendHeader("Content-Encoding", "gzip");
+    }
+    setContentLength(file.size());
+    send(code, contentType.c_str(), emptyString);
+    if (method == HTTP_HEAD) return 0;
+
+    uint8_t block[1460];
+    size_t total = 0;
+    int n;
+    while ((n = file.read(block, sizeof(block))) > 0) {
+      total += writeClient(block, n);
+    }
+    return total;
+  }
+
+  template <typename T>
+  size_t streamFile(T& file, const String& contentType, int code = 200) {
+    return streamFile(file, contentType, requestMethod, code);
+  }
+
+  static String urlDecode(const String& text);
+
+  // Host only: the port to listen on instead of the one in the sketch
+  void setPort(int newPort) { port = newPort; }
+
+ private:
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+    THandlerFunction uploadHandler;
+  };
+
+  bool readRequest();
+  bool readHeaders(String& head);
+  bool readBody(const Route* route);
+  bool readMultipart(const Route* route, const String& boundary, size_t length);
+  void parseArguments(const String& query);
+  void addArgument(const String& name, const String& value);
+  const Route* findRoute() const;
+  void finishRequest(bool keepConnection);
+  size_t writeClient(const void* data, size_t length);
+  int readClient(uint8_t* buffer, size_t length);
+
+  int port;
+  int listenFd = -1;
+  WiFiClient currentClient;
+
+  std::vector<Route> routes;
+  THandlerFunction notFoundHandler;
+  std::vector<HookFunction> hooks;
+
+  // Current request
+  HTTPMethod requestMethod = HTTP_GET;
+  String requestUri;
+  bool requestKeepAlive = false;
+  std::vector<String> argNames;
+  std::vector<String> argValues;
+  std::vector<String> headerNames;
+  std::vector<String> headerValues;
+  HTTPUpload currentUpload;
+  std::string pending;  // Bytes read past the headers
+
+  // Current response
+  bool keepAliveEnabled = false;
+  size_t contentLength = CONTENT_LENGTH_NOT_SET;
+  String responseHeaders;
+  bool responseStarted = false;
+  bool chunked = false;
+};
+
+#endif // HOST_ESP8266WEBSERVER_H
@@ -0,0 +1,61 @@
+/*
+ * ESP8266WiFi.h - Host Stand-In for the ESP8266 WiFi Library
+ *
+ * The station is always connected on the host. WiFiClient wraps a real TCP
+ * socket accepted by the host ESP8266WebServer.
+ */
+
+#ifndef HOST_ESP8266WIFI_H
+#define HOST_ESP8266WIFI_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+#define WIFI_STA 1
+
+class WiFiClass {
+ public:
+  void mode(int mode) {}
+  void begin(const char* ssid, const char* password) {}
+  void disconnect() {}
+  int status() { return WL_CONNECTED; }
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+};
+
+extern WiFiClass WiFi;
+
+// NTP is left to the host clock
+inline void configTime(long gmtOffset, int daylightOffset, const char* server) {}
+
+class WiFiClient : public Stream {
+ public:
+  WiFiClient() {}
+  WiFiClient(int fd, IPAddress remoteIP, uint16_t remotePort) : fd(fd), address(remoteIP), port(remotePort) {}
+
+  size_t write(const uint8_t* data, size_t length) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buffer, size_t length);
+  int peek() override;
+
+  // False once either side has closed the connection
+  bool connected();
+  void stop();
+  void setNoDelay(bool noDelay) {}
+
+  IPAddress remoteIP() const { return address; }
+  uint16_t remotePort() const { return port; }
+  int socket() const { return fd; }
+
+ private:
+  int fd = -1;
+  IPAddress address;
+  uint16_t port = 0;
+};
+
+#endif // HOST_ESP8266WIFI_H
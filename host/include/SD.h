@@ -0,0 +1,74 @@
+/*
+ * SD.h - Host Stand-In for the ESP8266 SD Library
+ *
+ * Paths are resolved under a directory on the host (--sd, by default
+ * sd-card-content/), which plays the part of the card.
+ */
+
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+#include <memory>
+#include <vector>
+#include "Arduino.h"
+
+#define FILE_READ 0
+#define FILE_WRITE 1  // Read and write, starting at the end, like O_APPEND
+
+class File : public Stream {
+ public:
+  File() {}
+
+  explicit operator bool() const { return handle != nullptr || directory; }
+
+  size_t write(const uint8_t* data, size_t length) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buffer, size_t length);
+  int peek() override;
+  void flush() override;
+
+  bool seek(uint32_t position);
+  size_t position() const;
+  size_t size() const;
+  void close();
+
+  const char* name() const;
+  const char* fullName() const { return path.c_str(); }
+  bool isDirectory() const { return directory; }
+  File openNextFile();
+  void rewindDirectory() { nextEntry = 0; }
+  time_t getLastWrite() const;
+
+ private:
+  friend class SDClass;
+
+  // Shared, so copies of a File refer to the same open file, as on the device
+  std::shared_ptr<FILE> handle;
+  String path;
+  bool directory = false;
+  std::vector<String> entries;
+  size_t nextEntry = 0;
+};
+
+class SDClass {
+ public:
+  bool begin(int csPin);
+  File open(const String& path, int mode = FILE_READ);
+  File open(const char* path, int mode = FILE_READ) { return open(String(path), mode); }
+  bool exists(const String& path);
+  bool remove(const String& path);
+  bool rename(const String& from, const String& to);
+  bool mkdir(const String& path);
+  bool rmdir(const String& path);
+
+  // Host path of a card path
+  String hostPath(const String& path) const { return root + path; }
+
+  String root = "sd-card-content";
+};
+
+extern SDClass SD;
+
+#endif // HOST_SD_H
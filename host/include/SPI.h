@@ -0,0 +1,8 @@
+/*
+ * SPI.h - Host Stand-In; the SD card is a host directory, so there is no bus
+ */
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#endif // HOST_SPI_H
@@ -0,0 +1,392 @@
+/*
+ * loadgen.cpp - Replay an Access Log Against the Blog Server
+ *
+ * Reads access.log as written by the firmware, replays its GET and HEAD
+ * requests with the logged User-Agent, and reports throughput, latency
+ * percentiles and the peak simulated heap of a host build.
+ *
+ * Usage: loadgen [--host ADDR] [--port N] [--repeat N] [-c CONNECTIONS] [--no-keepalive] access.log
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Request {
+  std::string method;
+  std::string uri;
+  int status;  // As logged
+  std::string userAgent;
+};
+
+struct Response {
+  int status = 0;
+  size_t bytes = 0;
+  bool keepAlive = false;
+};
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  int repeat = 1;
+  int connections = 1;
+  bool keepAlive = true;
+  std::string logPath;
+};
+
+struct Totals {
+  std::mutex lock;
+  std::vector<double> latencies;  // Milliseconds
+  size_t errors = 0;
+  size_t mismatches = 0;
+  size_t bytes = 0;
+};
+
+void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options] access.log\n"
+          "  --host ADDR       Server address (default: 127.0.0.1)\n"
+          "  --port N          Server port (default: 8080)\n"
+          "  --repeat N        Replay the log N times (default: 1)\n"
+          "  -c N              Concurrent connections (default: 1)\n"
+          "  --no-keepalive    Open a new connection for every request\n",
+          program);
+  exit(2);
+}
+
+// ============================================================================
+// LOG PARSING
+// ============================================================================
+
+// [timestamp] ip - METHOD uri - status - "user agent"
+bool parseLogLine(const std::string& line, Request& request) {
+  size_t afterTimestamp = line.find("] ");
+  if (line.empty() || line[0] != '[' || afterTimestamp == std::string::npos) return false;
+
+  size_t methodStart = line.find(" - ", afterTimestamp);
+  if (methodStart == std::string::npos) return false;
+  methodStart += 3;
+  size_t uriStart = line.find(' ', methodStart);
+  size_t uriEnd = line.rfind(" - \"");
+  if (uriStart == std::string::npos || uriEnd == std::string::npos || uriEnd <= uriStart) return false;
+
+  // The URI may contain " - ", so the status is found from the end
+  size_t statusStart = line.rfind(" - ", uriEnd - 1);
+  if (statusStart == std::string::npos || statusStart <= uriStart) return false;
+
+  request.method = line.substr(methodStart, uriStart - methodStart);
+  request.uri = line.substr(uriStart + 1, statusStart - uriStart - 1);
+  request.status = atoi(line.c_str() + statusStart + 3);
+  request.userAgent = line.substr(uriEnd + 4);
+  if (!request.userAgent.empty() && request.userAgent.back() == '"') request.userAgent.pop_back();
+  if (request.userAgent == "-") request.userAgent.clear();
+  return true;
+}
+
+// The log holds decoded URIs
+std::string encodeUri(const std::string& uri) {
+  std::string encoded;
+  for (unsigned char c : uri) {
+    if (c <= 0x20 || c >= 0x7f || c == '%') {
+      char escape[4];
+      snprintf(escape, sizeof(escape), "%%%02X", c);
+      encoded += escape;
+    } else {
+      encoded += c;
+    }
+  }
+  return encoded;
+}
+
+std::vector<Request> loadRequests(const std::string& path) {
+  std::vector<Request> requests;
+  std::ifstream log(path);
+  if (!log) {
+    fprintf(stderr, "Could not open %s\n", path.c_str());
+    exit(1);
+  }
+
+  std::string line;
+  size_t skipped = 0;
+  while (std::getline(log, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    Request request;
+    if (parseLogLine(line, request) && (request.method == "GET" || request.method == "HEAD")) {
+      request.uri = encodeUri(request.uri);
+      requests.push_back(request);
+    } else if (!line.empty()) {
+      skipped++;
+    }
+  }
+  if (skipped > 0) fprintf(stderr, "Skipped %zu lines that aren't GET or HEAD requests\n", skipped);
+  return requests;
+}
+
+// ============================================================================
+// HTTP CLIENT
+// ============================================================================
+
+class Connection {
+ public:
+  Connection(const Options& options) : options(options) {}
+  ~Connection() { close(); }
+
+  bool exchange(const Request& request, Response& response) {
+    if (fd < 0 && !open()) return false;
+
+    std::string text = request.method + " " + request.uri + " HTTP/1.1\r\n";
+    text += "Host: " + options.host + "\r\n";
+    if (!request.userAgent.empty()) text += "User-Agent: " + request.userAgent + "\r\n";
+    text += "Accept-Encoding: gzip\r\n";
+    if (!options.keepAlive) text += "Connection: close\r\n";
+    text += "\r\n";
+
+    if (::send(fd, text.data(), text.size(), MSG_NOSIGNAL) != (ssize_t)text.size() ||
+        !readResponse(request.method == "HEAD", response)) {
+      close();
+      return false;
+    }
+    if (!response.keepAlive) close();
+    return true;
+  }
+
+  void close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    buffer.clear();
+  }
+
+ private:
+  bool open() {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  bool fill() {
+    char block[4096];
+    ssize_t n = recv(fd, block, sizeof(block), 0);
+    if (n <= 0) return false;
+    buffer.append(block, n);
+    return true;
+  }
+
+  bool readLine(std::string& line) {
+    size_t end;
+    while ((end = buffer.find("\r\n")) == std::string::npos) {
+      if (!fill()) return false;
+    }
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 2);
+    return true;
+  }
+
+  bool readBytes(size_t length) {
+    while (buffer.size() < length) {
+      if (!fill()) return false;
+    }
+    buffer.erase(0, length);
+    return true;
+  }
+
+  bool readResponse(bool head, Response& response) {
+    std::string line;
+    if (!readLine(line) || line.compare(0, 5, "HTTP/") != 0) return false;
+    size_t space = line.find(' ');
+    response.status = atoi(line.c_str() + space + 1);
+    response.keepAlive = line.compare(0, 8, "HTTP/1.1") == 0;
+
+    long contentLength = -1;
+    bool chunked = false;
+    while (readLine(line) && !line.empty()) {
+      std::string name = line.substr(0, line.find(':'));
+      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+      std::string value = line.substr(std::min(line.size(), name.size() + 2));
+      if (name == "content-length") contentLength = atol(value.c_str());
+      if (name == "transfer-encoding" && value.find("chunked") != std::string::npos) chunked = true;
+      if (name == "connection") response.keepAlive = (value != "close");
+    }
+    if (!line.empty()) return false;
+
+    response.bytes = 0;
+    if (head || response.status == 304 || response.status == 204) return true;
+
+    if (chunked) {
+      while (readLine(line)) {
+        size_t size = strtoul(line.c_str(), nullptr, 16);
+        if (!readBytes(size + 2)) return false;
+        response.bytes += size;
+        if (size == 0) return true;
+      }
+      return false;
+    }
+    if (contentLength >= 0) {
+      response.bytes = contentLength;
+      return readBytes(contentLength);
+    }
+
+    // No length: the body runs to the end of the connection
+    while (fill()) {}
+    response.bytes = buffer.size();
+    response.keepAlive = false;
+    return true;
+  }
+
+  const Options& options;
+  int fd = -1;
+  std::string buffer;
+};
+
+// ============================================================================
+// REPLAY
+// ============================================================================
+
+void replay(const Options& options, const std::vector<Request>& requests, std::atomic<size_t>& next, Totals& totals) {
+  Connection connection(options);
+  std::vector<double> latencies;
+  size_t errors = 0, mismatches = 0, bytes = 0;
+  size_t total = requests.size() * options.repeat;
+
+  for (size_t i = next++; i < total; i = next++) {
+    const Request& request = requests[i % requests.size()];
+    Response response;
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = connection.exchange(request, response);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (!ok) {
+      errors++;
+      continue;
+    }
+    latencies.push_back(std::chrono::duration<double, std::milli>(elapsed).count());
+    bytes += response.bytes;
+    // 304s depend on what the client has cached, so they match a 200
+    if (response.status != request.status && !(response.status == 200 && request.status == 304)) mismatches++;
+  }
+
+  std::lock_guard<std::mutex> guard(totals.lock);
+  totals.latencies.insert(totals.latencies.end(), latencies.begin(), latencies.end());
+  totals.errors += errors;
+  totals.mismatches += mismatches;
+  totals.bytes += bytes;
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+  if (sorted.empty()) return 0;
+  size_t index = std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()));
+  return sorted[index];
+}
+
+// Reads the /__host/heap JSON from a host build; empty on a device
+std::string hostHeapReport(const Options& options, const char* uri) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(options.port);
+  inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+  std::string reply;
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+    std::string text = std::string("GET ") + uri + " HTTP/1.1\r\nHost: " + options.host + "\r\nConnection: close\r\n\r\n";
+    ::send(fd, text.data(), text.size(), MSG_NOSIGNAL);
+    char block[1024];
+    ssize_t n;
+    while ((n = recv(fd, block, sizeof(block), 0)) > 0) reply.append(block, n);
+  }
+  ::close(fd);
+
+  size_t body = reply.find("\r\n\r\n");
+  if (reply.compare(0, 12, "HTTP/1.1 200") != 0 || body == std::string::npos) return "";
+  return reply.substr(body + 4);
+}
+
+long jsonNumber(const std::string& json, const char* key) {
+  size_t at = json.find(std::string("\"") + key + "\":");
+  return at == std::string::npos ? -1 : atol(json.c_str() + at + strlen(key) + 3);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string option = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (option == "--host" && hasValue) {
+      options.host = argv[++i];
+    } else if (option == "--port" && hasValue) {
+      options.port = atoi(argv[++i]);
+    } else if (option == "--repeat" && hasValue) {
+      options.repeat = std::max(1, atoi(argv[++i]));
+    } else if (option == "-c" && hasValue) {
+      options.connections = std::max(1, atoi(argv[++i]));
+    } else if (option == "--no-keepalive") {
+      options.keepAlive = false;
+    } else if (option[0] != '-' && options.logPath.empty()) {
+      options.logPath = option;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.logPath.empty()) usage(argv[0]);
+
+  std::vector<Request> requests = loadRequests(options.logPath);
+  if (requests.empty()) {
+    fprintf(stderr, "No requests to replay in %s\n", options.logPath.c_str());
+    return 1;
+  }
+
+  // Start the peak from the server's idle state
+  hostHeapReport(options, "/__host/heap?reset=1");
+
+  Totals totals;
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < options.connections; i++) {
+    workers.emplace_back(replay, std::cref(options), std::cref(requests), std::ref(next), std::ref(totals));
+  }
+  for (std::thread& worker : workers) worker.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<double>& latencies = totals.latencies;
+  std::sort(latencies.begin(), latencies.end());
+
+  printf("Requests:      %zu (%zu errors, %zu status mismatches)\n", latencies.size() + totals.errors,
+         totals.errors, totals.mismatches);
+  printf("Duration:      %.2f s\n", seconds);
+  printf("Throughput:    %.1f requests/s, %.1f KB/s\n", latencies.size() / seconds, totals.bytes / 1024.0 / seconds);
+  printf("Latency (ms):  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", percentile(latencies, 0.50),
+         percentile(latencies, 0.90), percentile(latencies, 0.99), latencies.empty() ? 0 : latencies.back());
+
+  std::string heap = hostHeapReport(options, "/__host/heap");
+  if (!heap.empty()) {
+    printf("Peak heap:     %ld of %ld bytes (simulated)\n", jsonNumber(heap, "peak"), jsonNumber(heap, "size"));
+  }
+  return totals.errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * routebench.cpp - Route Count vs Lookup Time
+ *
+ * Loads generated routes.txt files of growing size through the firmware's
+ * own loadPostMappings() and times findPostMapping() against a linear scan
+ * of the same table, the way requests were resolved before the hash index.
+ * Each count is timed for a path that isn't listed (the 404 case, which
+ * the linear scan pays for in full) and for the last route listed.
+ * A table holds at most 64 KB of strings, about 2600 of these routes.
+ *
+ * Usage: routebench [--lookups N] [COUNT...]
+ */
+
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <vector>
+#include "esp82_blog_server.ino"
+
+namespace {
+
+volatile int lookupSink;
+
+// The lookup the hash index replaced
+int findPostMappingLinear(const String& path) {
+  for (int i = 0; i < postMappingsCount; i++) {
+    if (strcmp(postMappings[i].urlPath(), path.c_str()) == 0) return i;
+  }
+  return -1;
+}
+
+// Nanoseconds per call of find(path), averaged over lookups calls
+template <typename Find>
+double timeLookups(Find find, const String& path, long lookups) {
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < lookups; i++) {
+    lookupSink = find(path);
+  }
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / lookups;
+}
+
+void writeRoutes(const std::filesystem::path& root, int count) {
+  FILE* file = fopen((root / "config" / "routes.txt").c_str(), "w");
+  for (int i = 0; i < count; i++) {
+    fprintf(file, "/p%05d|p%05d.md|P%d\n", i, i, i);
+  }
+  fclose(file);
+}
+
+void freeRoutes() {
+  delete[] postMappings;
+  delete[] postMappingStrings;
+  postMappings = nullptr;
+  postMappingStrings = nullptr;
+  freePathIndex(postMappingIndex);
+  postMappingsCount = 0;
+  delete[] blogPosts;
+  blogPosts = nullptr;
+  blogPostCount = 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  long lookups = 200000;
+  std::vector<int> counts;
+
+  for (int i = 1; i < argc; i++) {
+    String option = argv[i];
+    if (option == "--lookups" && i + 1 < argc) {
+      lookups = atol(argv[++i]);
+    } else if (atoi(argv[i]) > 0) {
+      counts.push_back(atoi(argv[i]));
+    } else {
+      fprintf(stderr, "Usage: %s [--lookups N] [COUNT...]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (counts.empty()) counts = { 10, 100, 1000, 2500 };
+
+  std::filesystem::path root = std::filesystem::temp_directory_path() / ("routebench-" + std::to_string(getpid()));
+  std::filesystem::create_directories(root / "config");
+  SD.root = root.c_str();
+  SD.begin(SD_CS_PIN);
+  Serial.enabled = false;
+
+  printf("%8s  %12s  %12s  %12s  %12s\n", "routes", "404 linear", "404 hashed", "hit linear", "hit hashed");
+  for (int count : counts) {
+    writeRoutes(root, count);
+    freeRoutes();
+    loadPostMappings();
+    if (postMappingsCount != count) {
+      fprintf(stderr, "Loaded %d of %d routes\n", postMappingsCount, count);
+      std::filesystem::remove_all(root);
+      return 1;
+    }
+
+    String missing = "/p-missing";
+    String last = postMappings[count - 1].urlPath();
+    printf("%8d  %9.0f ns  %9.0f ns  %9.0f ns  %9.0f ns\n", count,
+           timeLookups(findPostMappingLinear, missing, lookups),
+           timeLookups(findPostMapping, missing, lookups),
+           timeLookups(findPostMappingLinear, last, lookups),
+           timeLookups(findPostMapping, last, lookups));
+  }
+
+  freeRoutes();
+  std::filesystem::remove_all(root);
+  return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * arduino.cpp - Host Timing, GPIO and Serial
+ */
+
+#include <chrono>
+#include <thread>
+#include "Arduino.h"
+
+namespace {
+
+const auto bootTime = std::chrono::steady_clock::now();
+int pinValues[32];
+
+}  // namespace
+
+const String emptyString;
+HardwareSerial Serial;
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void digitalWrite(int pin, int value) {
+  if (pin >= 0 && pin < 32) pinValues[pin] = value;
+}
+
+int digitalRead(int pin) {
+  return (pin >= 0 && pin < 32) ? pinValues[pin] : LOW;
+}
+
+size_t HardwareSerial::write(const uint8_t* data, size_t length) {
+  return enabled ? fwrite(data, 1, length, stderr) : length;
+}
@@ -0,0 +1,86 @@
+/*
+ * heap.cpp - Simulated ESP8266 Heap
+ *
+ * Replaces the global operator new/delete to count live bytes against a
+ * heap the size of the ESP8266's, so ESP.getFreeHeap() answers as it
+ * would on the device. Allocations are larger on a 64-bit host (pointers,
+ * std::string), so the figures are an upper bound rather than exact.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "Arduino.h"
+#include "host.h"
+
+namespace {
+
+// Prefixed to each block; 16 bytes keeps the caller's pointer aligned
+struct BlockHeader {
+  size_t size;
+  size_t counted;  // Allocated while the simulation was running
+};
+
+size_t heapSize = DEFAULT_SIMULATED_HEAP;
+bool enforceLimit = false;
+bool running = false;
+size_t used = 0;
+size_t peak = 0;
+
+void* allocate(size_t size, bool throwOnFailure) {
+  if (running && enforceLimit && used + size > heapSize) {
+    fprintf(stderr, "FATAL: Simulated heap exhausted (%zu of %zu bytes in use, %zu requested)\n", used, heapSize, size);
+    abort();
+  }
+
+  BlockHeader* header = (BlockHeader*)malloc(sizeof(BlockHeader) + size);
+  if (!header) {
+    if (throwOnFailure) throw std::bad_alloc();
+    return nullptr;
+  }
+  header->size = size;
+  header->counted = running;
+  if (running) {
+    used += size;
+    if (used > peak) peak = used;
+  }
+  return header + 1;
+}
+
+void release(void* block) {
+  if (!block) return;
+  BlockHeader* header = (BlockHeader*)block - 1;
+  if (header->counted) used -= header->size;
+  free(header);
+}
+
+}  // namespace
+
+EspClass ESP;
+
+void startHeapSimulation(size_t size, bool enforce) {
+  heapSize = size;
+  enforceLimit = enforce;
+  running = true;
+}
+
+size_t simulatedHeapSize() { return heapSize; }
+size_t simulatedHeapUsed() { return used; }
+size_t simulatedHeapPeak() { return peak; }
+void resetSimulatedHeapPeak() { peak = used; }
+
+uint32_t EspClass::getFreeHeap() {
+  return used < heapSize ? heapSize - used : 0;
+}
+
+void* operator new(size_t size) { return allocate(size, true); }
+void* operator new[](size_t size) { return allocate(size, true); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size, false); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size, false); }
+
+void operator delete(void* block) noexcept { release(block); }
+void operator delete[](void* block) noexcept { release(block); }
+void operator delete(void* block, size_t) noexcept { release(block); }
+void operator delete[](void* block, size_t) noexcept { release(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { release(block); }
@@ -0,0 +1,23 @@
+/*
+ * host.h - Host Build Internals
+ *
+ * Settings and the simulated heap shared by the stand-ins and main.cpp
+ */
+
+#ifndef HOST_HOST_H
+#define HOST_HOST_H
+
+#include <cstddef>
+
+// Free heap of an ESP8266 running the blog after boot, roughly
+const size_t DEFAULT_SIMULATED_HEAP = 50000;
+
+// Counting starts here, so host start-up allocations are left out
+void startHeapSimulation(size_t heapSize, bool enforce);
+
+size_t simulatedHeapSize();
+size_t simulatedHeapUsed();
+size_t simulatedHeapPeak();
+void resetSimulatedHeapPeak();
+
+#endif // HOST_HOST_H
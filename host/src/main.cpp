@@ -0,0 +1,87 @@
+/*
+ * main.cpp - Run the Blog Firmware as a Linux Process
+ *
+ * Compiles the sketch unchanged against the host stand-ins in host/include
+ * and drives setup() and loop() like the ESP8266 core does.
+ *
+ * Usage: blog-server [--sd DIR] [--port N] [--heap BYTES] [--enforce-heap] [--quiet]
+ */
+
+#include <csignal>
+#include "esp82_blog_server.ino"
+#include "host.h"
+
+namespace {
+
+volatile sig_atomic_t stopRequested = 0;
+
+void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --sd DIR          Directory served as the SD card (default: sd-card-content)\n"
+          "  --port N          Port to listen on (default: 8080)\n"
+          "  --heap BYTES      Simulated free heap (default: %zu)\n"
+          "  --enforce-heap    Abort when the simulated heap runs out\n"
+          "  --quiet           Don't print Serial output\n",
+          program, DEFAULT_SIMULATED_HEAP);
+  exit(2);
+}
+
+// Host only: simulated heap figures for the load tester.
+// ?reset=1 starts a new peak after reporting the current one.
+void handleHostHeap() {
+  char body[128];
+  snprintf(body, sizeof(body), "{\"size\":%zu,\"used\":%zu,\"peak\":%zu,\"free\":%u}\n",
+           simulatedHeapSize(), simulatedHeapUsed(), simulatedHeapPeak(), ESP.getFreeHeap());
+  server.send(200, "application/json", body);
+  if (server.arg("reset") == "1") resetSimulatedHeapPeak();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int port = 8080;
+  size_t heapSize = DEFAULT_SIMULATED_HEAP;
+  bool enforceHeap = false;
+
+  for (int i = 1; i < argc; i++) {
+    String option = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (option == "--sd" && hasValue) {
+      SD.root = argv[++i];
+    } else if (option == "--port" && hasValue) {
+      port = atoi(argv[++i]);
+    } else if (option == "--heap" && hasValue) {
+      heapSize = strtoul(argv[++i], nullptr, 10);
+    } else if (option == "--enforce-heap") {
+      enforceHeap = true;
+    } else if (option == "--quiet") {
+      Serial.enabled = false;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  signal(SIGINT, [](int) { stopRequested = 1; });
+  signal(SIGTERM, [](int) { stopRequested = 1; });
+
+  if (!SD.begin(SD_CS_PIN)) return 1;
+  server.setPort(port);
+  startHeapSimulation(heapSize, enforceHeap);
+  setup();
+  server.on("/__host/heap", HTTP_GET, handleHostHeap);
+
+  while (!stopRequested) {
+    loop();
+  }
+
+  // Keep what a power cut would lose on the device
+  #if ENABLE_TRAFFIC_LOG
+  flushTrafficLog();
+  #endif
+  #if ENABLE_TRAFFIC_STATS
+  saveTrafficStats();
+  #endif
+  server.close();
+  return 0;
+}
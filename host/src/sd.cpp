@@ -0,0 +1,148 @@
+/*
+ * sd.cpp - SD Card Backed by a Host Directory
+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include "SD.h"
+
+SDClass SD;
+
+// ============================================================================
+// FILE
+// ============================================================================
+
+size_t File::write(const uint8_t* data, size_t length) {
+  return handle ? fwrite(data, 1, length, handle.get()) : 0;
+}
+
+int File::available() {
+  return handle ? (int)(size() - position()) : 0;
+}
+
+int File::read() {
+  return handle ? fgetc(handle.get()) : -1;
+}
+
+int File::read(uint8_t* buffer, size_t length) {
+  return handle ? (int)fread(buffer, 1, length, handle.get()) : -1;
+}
+
+int File::peek() {
+  if (!handle) return -1;
+  int c = fgetc(handle.get());
+  if (c >= 0) ungetc(c, handle.get());
+  return c;
+}
+
+void File::flush() {
+  if (handle) fflush(handle.get());
+}
+
+bool File::seek(uint32_t offset) {
+  return handle && fseek(handle.get(), offset, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+  return handle ? ftell(handle.get()) : 0;
+}
+
+size_t File::size() const {
+  struct stat info;
+  if (!handle) return 0;
+  fflush(handle.get());
+  return fstat(fileno(handle.get()), &info) == 0 ? info.st_size : 0;
+}
+
+void File::close() {
+  handle.reset();
+  directory = false;
+  entries.clear();
+}
+
+const char* File::name() const {
+  int slash = path.lastIndexOf('/');
+  return path.c_str() + slash + 1;
+}
+
+File File::openNextFile() {
+  if (!directory || nextEntry >= entries.size()) return File();
+  String base = path.endsWith("/") ? path : path + "/";
+  return SD.open(base + entries[nextEntry++]);
+}
+
+time_t File::getLastWrite() const {
+  struct stat info;
+  if (directory) return stat(SD.hostPath(path).c_str(), &info) == 0 ? info.st_mtime : 0;
+  return (handle && fstat(fileno(handle.get()), &info) == 0) ? info.st_mtime : 0;
+}
+
+// ============================================================================
+// CARD
+// ============================================================================
+
+bool SDClass::begin(int csPin) {
+  struct stat info;
+  if (stat(root.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+    fprintf(stderr, "SD directory %s not found\n", root.c_str());
+    return false;
+  }
+  return true;
+}
+
+File SDClass::open(const String& path, int mode) {
+  File file;
+  file.path = path;
+  String real = hostPath(path);
+
+  struct stat info;
+  if (stat(real.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+    if (mode == FILE_WRITE) return File();
+    DIR* dir = opendir(real.c_str());
+    if (!dir) return File();
+    while (struct dirent* entry = readdir(dir)) {
+      if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+        file.entries.push_back(String(entry->d_name));
+      }
+    }
+    closedir(dir);
+    std::sort(file.entries.begin(), file.entries.end());
+    file.directory = true;
+    return file;
+  }
+
+  FILE* handle = fopen(real.c_str(), mode == FILE_WRITE ? "a+" : "rb");
+  if (!handle) return File();
+  if (mode == FILE_WRITE) fseek(handle, 0, SEEK_END);
+  file.handle = std::shared_ptr<FILE>(handle, fclose);
+  return file;
+}
+
+bool SDClass::exists(const String& path) {
+  struct stat info;
+  return stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool SDClass::remove(const String& path) {
+  return unlink(hostPath(path).c_str()) == 0;
+}
+
+// FAT won't rename over an existing file, so neither does this
+bool SDClass::rename(const String& from, const String& to) {
+  if (exists(to)) return false;
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+// Creates missing parent directories too, as SdFat does
+bool SDClass::mkdir(const String& path) {
+  for (int slash = path.indexOf('/', 1); slash > 0; slash = path.indexOf('/', slash + 1)) {
+    ::mkdir(hostPath(path.substring(0, slash)).c_str(), 0755);
+  }
+  return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool SDClass::rmdir(const String& path) {
+  return ::rmdir(hostPath(path).c_str()) == 0;
+}
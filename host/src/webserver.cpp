@@ -0,0 +1,545 @@
+/*
+ * webserver.cpp - HTTP/1.1 Server on a Host Socket
+ *
+ * Serves one connection at a time, like the ESP8266 core: while a
+ * kept-alive client is connected, new connections wait in the backlog.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ESP8266WebServer.h"
+
+namespace {
+
+const int POLL_MS = 5;                  // How long handleClient() waits for work
+const unsigned long IDLE_CLOSE_MS = 5000;  // The core's HTTP_MAX_DATA_WAIT
+const size_t MAX_HEADER_SIZE = 8192;
+const size_t READ_BLOCK = 4096;
+
+unsigned long clientIdleSince = 0;
+
+const char* reasonPhrase(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "";
+  }
+}
+
+HTTPMethod parseMethod(const String& name) {
+  if (name == "GET") return HTTP_GET;
+  if (name == "HEAD") return HTTP_HEAD;
+  if (name == "POST") return HTTP_POST;
+  if (name == "PUT") return HTTP_PUT;
+  if (name == "PATCH") return HTTP_PATCH;
+  if (name == "DELETE") return HTTP_DELETE;
+  if (name == "OPTIONS") return HTTP_OPTIONS;
+  return HTTP_ANY;
+}
+
+// Value of attribute in a header such as Content-Disposition, or ""
+String headerAttribute(const String& header, const String& attribute) {
+  int start = header.indexOf(attribute + "=");
+  if (start < 0) return String();
+  start += attribute.length() + 1;
+  if (header[start] == '"') {
+    int end = header.indexOf('"', start + 1);
+    return header.substring(start + 1, end < 0 ? header.length() : end);
+  }
+  int end = header.indexOf(';', start);
+  String value = header.substring(start, end < 0 ? header.length() : end);
+  value.trim();
+  return value;
+}
+
+}  // namespace
+
+// ============================================================================
+// LISTENING
+// ============================================================================
+
+void ESP8266WebServer::begin() {
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int enable = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 16) != 0) {
+    fprintf(stderr, "Could not listen on port %d: %s\n", port, strerror(errno));
+    exit(1);
+  }
+  fprintf(stderr, "Listening on http://127.0.0.1:%d/\n", port);
+}
+
+void ESP8266WebServer::close() {
+  currentClient.stop();
+  if (listenFd >= 0) ::close(listenFd);
+  listenFd = -1;
+}
+
+void ESP8266WebServer::on(const String& uri, HTTPMethod method, THandlerFunction handler, THandlerFunction uploadHandler) {
+  routes.push_back({ uri, method, handler, uploadHandler });
+}
+
+void ESP8266WebServer::handleClient() {
+  if (listenFd < 0) return;
+
+  if (!currentClient.connected()) {
+    struct pollfd waiting = { listenFd, POLLIN, 0 };
+    if (poll(&waiting, 1, POLL_MS) <= 0) return;
+
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    int fd = accept(listenFd, (struct sockaddr*)&address, &addressLength);
+    if (fd < 0) return;
+
+    // Chunks are small; without this, Nagle and delayed ACKs add 40ms stalls
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    uint8_t* ip = (uint8_t*)&address.sin_addr.s_addr;
+    currentClient = WiFiClient(fd, IPAddress(ip[0], ip[1], ip[2], ip[3]), ntohs(address.sin_port));
+    pending.clear();
+    clientIdleSince = millis();
+  }
+
+  if (pending.empty()) {
+    struct pollfd waiting = { currentClient.socket(), POLLIN, 0 };
+    if (poll(&waiting, 1, POLL_MS) <= 0) {
+      if (millis() - clientIdleSince > IDLE_CLOSE_MS) currentClient.stop();
+      return;
+    }
+  }
+
+  if (!readRequest()) {
+    currentClient.stop();
+    return;
+  }
+
+  // Hooks run first and may take the request over
+  ContentTypeFunction contentType = [](const String& path) { return String("application/octet-stream"); };
+  static const char* const methodNames[] = { "ANY", "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS" };
+  for (HookFunction& hook : hooks) {
+    ClientFuture future = hook(methodNames[requestMethod], requestUri, &currentClient, contentType);
+    if (future == CLIENT_MUST_STOP) {
+      currentClient.stop();
+      return;
+    }
+    if (future == CLIENT_IS_GIVEN) {
+      currentClient = WiFiClient();
+      return;
+    }
+    if (future == CLIENT_REQUEST_IS_HANDLED) {
+      finishRequest(true);
+      return;
+    }
+  }
+
+  const Route* route = findRoute();
+  responseHeaders = String();
+  responseStarted = false;
+  chunked = false;
+  contentLength = CONTENT_LENGTH_NOT_SET;
+
+  if (!readBody(route)) {
+    send(400, "text/plain", "Bad request body");
+    finishRequest(false);
+    return;
+  }
+
+  if (route) {
+    route->handler();
+  } else if (notFoundHandler) {
+    notFoundHandler();
+  } else {
+    send(404, "text/plain", "Not found: " + requestUri);
+  }
+
+  if (!responseStarted) {
+    send(500, "text/plain", "Handler sent no response");
+  } else if (chunked) {
+    sendContent("", 0);
+  }
+  finishRequest(true);
+}
+
+void ESP8266WebServer::finishRequest(bool keepConnection) {
+  if (!keepConnection || !requestKeepAlive || !keepAliveEnabled) {
+    currentClient.stop();
+  }
+  clientIdleSince = millis();
+}
+
+const ESP8266WebServer::Route* ESP8266WebServer::findRoute() const {
+  for (const Route& route : routes) {
+    if (route.uri == requestUri && (route.method == HTTP_ANY || route.method == requestMethod)) {
+      return &route;
+    }
+  }
+  return nullptr;
+}
+
+// ============================================================================
+// REQUEST PARSING
+// ============================================================================
+
+int ESP8266WebServer::readClient(uint8_t* buffer, size_t length) {
+  if (!pending.empty()) {
+    size_t n = min(length, pending.size());
+    memcpy(buffer, pending.data(), n);
+    pending.erase(0, n);
+    return n;
+  }
+  return currentClient.read(buffer, length);
+}
+
+bool ESP8266WebServer::readHeaders(String& head) {
+  std::string data;
+  data.swap(pending);
+
+  size_t end;
+  while ((end = data.find("\r\n\r\n")) == std::string::npos) {
+    if (data.size() > MAX_HEADER_SIZE) return false;
+    uint8_t block[READ_BLOCK];
+    int n = currentClient.read(block, sizeof(block));
+    if (n <= 0) return false;
+    data.append((const char*)block, n);
+  }
+
+  head = String(data.substr(0, end));
+  pending = data.substr(end + 4);
+  return true;
+}
+
+bool ESP8266WebServer::readRequest() {
+  String head;
+  if (!readHeaders(head)) return false;
+
+  argNames.clear();
+  argValues.clear();
+  headerNames.clear();
+  headerValues.clear();
+
+  // Request line: METHOD URI VERSION
+  int lineEnd = head.indexOf("\r\n");
+  String requestLine = head.substring(0, lineEnd < 0 ? head.length() : lineEnd);
+  int firstSpace = requestLine.indexOf(' ');
+  int secondSpace = requestLine.indexOf(' ', firstSpace + 1);
+  if (firstSpace < 0 || secondSpace < 0) return false;
+
+  requestMethod = parseMethod(requestLine.substring(0, firstSpace));
+  String url = requestLine.substring(firstSpace + 1, secondSpace);
+  String version = requestLine.substring(secondSpace + 1);
+
+  int query = url.indexOf('?');
+  requestUri = urlDecode(query < 0 ? url : url.substring(0, query));
+  if (query >= 0) parseArguments(url.substring(query + 1));
+
+  while (lineEnd >= 0) {
+    int start = lineEnd + 2;
+    lineEnd = head.indexOf("\r\n", start);
+    String line = head.substring(start, lineEnd < 0 ? head.length() : lineEnd);
+    int colon = line.indexOf(':');
+    if (colon <= 0) continue;
+
+    String value = line.substring(colon + 1);
+    value.trim();
+    headerNames.push_back(line.substring(0, colon));
+    headerValues.push_back(value);
+  }
+
+  String connection = header("Connection");
+  connection.toLowerCase();
+  requestKeepAlive = (version == "HTTP/1.1") ? connection != "close" : connection == "keep-alive";
+  return true;
+}
+
+// Form fields become arguments, other bodies the "plain" argument;
+// multipart file parts go to the route's upload handler
+bool ESP8266WebServer::readBody(const Route* route) {
+  size_t length = header("Content-Length").toInt();
+  if (length == 0) return true;
+
+  String type = header("Content-Type");
+  if (type.startsWith("multipart/form-data")) {
+    String boundary = headerAttribute(type, "boundary");
+    return boundary.length() > 0 && readMultipart(route, boundary, length);
+  }
+
+  std::string body;
+  while (body.size() < length) {
+    uint8_t block[READ_BLOCK];
+    int n = readClient(block, min(sizeof(block), length - body.size()));
+    if (n <= 0) return false;
+    body.append((const char*)block, n);
+  }
+
+  if (type.startsWith("application/x-www-form-urlencoded")) {
+    parseArguments(String(body));
+  } else {
+    addArgument("plain", String(body));
+  }
+  return true;
+}
+
+bool ESP8266WebServer::readMultipart(const Route* route, const String& boundary, size_t length) {
+  std::string data;
+  size_t remaining = length;
+  auto fill = [&]() {
+    uint8_t block[READ_BLOCK];
+    int n = remaining > 0 ? readClient(block, min(sizeof(block), remaining)) : -1;
+    if (n <= 0) return false;
+    data.append((const char*)block, n);
+    remaining -= n;
+    return true;
+  };
+
+  // Like the core's _parseForm(), text fields become arguments only once the
+  // whole form is read, so an upload handler sees just the query string
+  std::vector<std::pair<String, String>> fields;
+  
+  std::string delimiter = std::string("--") + boundary.c_str();
+  while (data.size() < delimiter.size() + 2) {
+    if (!fill()) return false;
+  }
+  if (data.compare(0, delimiter.size(), delimiter) != 0) return false;
+  data.erase(0, delimiter.size() + 2);
+  delimiter = "\r\n" + delimiter;
+
+  while (true) {
+    size_t headEnd;
+    while ((headEnd = data.find("\r\n\r\n")) == std::string::npos) {
+      if (!fill()) return false;
+    }
+    String partHead = String(data.substr(0, headEnd));
+    data.erase(0, headEnd + 4);
+
+    String disposition;
+    String partType = "text/plain";
+    int start = 0;
+    while (start < (int)partHead.length()) {
+      int end = partHead.indexOf("\r\n", start);
+      if (end < 0) end = partHead.length();
+      String line = partHead.substring(start, end);
+      if (line.startsWith("Content-Disposition:") || line.startsWith("content-disposition:")) disposition = line;
+      if (line.startsWith("Content-Type:") || line.startsWith("content-type:")) {
+        partType = line.substring(13);
+        partType.trim();
+      }
+      start = end + 2;
+    }
+    String name = headerAttribute(disposition, "name");
+    bool isFile = disposition.indexOf("filename=") >= 0;
+    bool toUpload = isFile && route && route->uploadHandler;
+
+    HTTPUpload& upload = currentUpload;
+    if (toUpload) {
+      upload.status = UPLOAD_FILE_START;
+      upload.filename = headerAttribute(disposition, "filename");
+      upload.name = name;
+      upload.type = partType;
+      upload.totalSize = 0;
+      upload.currentSize = 0;
+      upload.contentLength = length;
+      route->uploadHandler();
+    }
+
+    // Pass on everything that can't be the start of the delimiter
+    String fieldValue;
+    size_t found;
+    while (true) {
+      found = data.find(delimiter);
+      size_t ready = (found != std::string::npos) ? found
+                     : (data.size() > delimiter.size() ? data.size() - delimiter.size() : 0);
+      while (ready > 0) {
+        size_t n = toUpload ? min(ready, (size_t)HTTP_UPLOAD_BUFLEN) : ready;
+        if (toUpload) {
+          memcpy(upload.buf, data.data(), n);
+          upload.status = UPLOAD_FILE_WRITE;
+          upload.currentSize = n;
+          upload.totalSize += n;
+          route->uploadHandler();
+        } else if (!isFile) {
+          fieldValue.concat(data.data(), n);
+        }
+        data.erase(0, n);
+        ready -= n;
+        if (found != std::string::npos) found -= n;
+      }
+      if (found != std::string::npos) break;
+      if (!fill()) {
+        if (toUpload) {
+          upload.status = UPLOAD_FILE_ABORTED;
+          route->uploadHandler();
+        }
+        return false;
+      }
+    }
+
+    if (toUpload) {
+      upload.status = UPLOAD_FILE_END;
+      upload.currentSize = 0;
+      route->uploadHandler();
+    } else if (!isFile) {
+      fields.push_back({ name, fieldValue });
+    }
+
+    data.erase(0, delimiter.size());
+    while (data.size() < 2) {
+      if (!fill()) return false;
+    }
+    if (data.compare(0, 2, "--") == 0) break;
+    data.erase(0, 2);
+  }
+
+  // Discard the epilogue
+  while (remaining > 0 && fill()) {}
+  for (auto& field : fields) addArgument(field.first, field.second);
+  return true;
+}
+
+void ESP8266WebServer::parseArguments(const String& query) {
+  int start = 0;
+  while (start < (int)query.length()) {
+    int end = query.indexOf('&', start);
+    if (end < 0) end = query.length();
+    String pair = query.substring(start, end);
+    int equals = pair.indexOf('=');
+    if (pair.length() > 0) {
+      addArgument(urlDecode(equals < 0 ? pair : pair.substring(0, equals)),
+                  equals < 0 ? String() : urlDecode(pair.substring(equals + 1)));
+    }
+    start = end + 1;
+  }
+}
+
+void ESP8266WebServer::addArgument(const String& name, const String& value) {
+  argNames.push_back(name);
+  argValues.push_back(value);
+}
+
+String ESP8266WebServer::urlDecode(const String& text) {
+  String decoded;
+  decoded.reserve(text.length());
+  for (unsigned int i = 0; i < text.length(); i++) {
+    char c = text[i];
+    if (c == '+') {
+      decoded += ' ';
+    } else if (c == '%' && i + 2 < text.length()) {
+      char hex[3] = { text[i + 1], text[i + 2], 0 };
+      decoded += (char)strtol(hex, nullptr, 16);
+      i += 2;
+    } else {
+      decoded += c;
+    }
+  }
+  return decoded;
+}
+
+String ESP8266WebServer::arg(const String& name) const {
+  for (size_t i = 0; i < argNames.size(); i++) {
+    if (argNames[i] == name) return argValues[i];
+  }
+  return String();
+}
+
+bool ESP8266WebServer::hasArg(const String& name) const {
+  for (const String& argName : argNames) {
+    if (argName == name) return true;
+  }
+  return false;
+}
+
+String ESP8266WebServer::header(const String& name) const {
+  for (size_t i = 0; i < headerNames.size(); i++) {
+    if (headerNames[i].equalsIgnoreCase(name)) return headerValues[i];
+  }
+  return String();
+}
+
+bool ESP8266WebServer::hasHeader(const String& name) const {
+  for (const String& headerName : headerNames) {
+    if (headerName.equalsIgnoreCase(name)) return true;
+  }
+  return false;
+}
+
+// ============================================================================
+// RESPONSES
+// ============================================================================
+
+size_t ESP8266WebServer::writeClient(const void* data, size_t length) {
+  return currentClient.write((const uint8_t*)data, length);
+}
+
+void ESP8266WebServer::sendHeader(const String& name, const String& value, bool first) {
+  String line = name + ": " + value + "\r\n";
+  responseHeaders = first ? line + responseHeaders : responseHeaders + line;
+}
+
+void ESP8266WebServer::send(int code, const char* contentType, const String& content) {
+  bool keepConnection = requestKeepAlive && keepAliveEnabled;
+  String head = "HTTP/1.1 " + String(code) + " " + reasonPhrase(code) + "\r\n";
+  if (contentType && *contentType) {
+    head += "Content-Type: " + String(contentType) + "\r\n";
+  }
+  if (contentLength == CONTENT_LENGTH_UNKNOWN) {
+    head += "Transfer-Encoding: chunked\r\n";
+  } else {
+    size_t length = (contentLength == CONTENT_LENGTH_NOT_SET) ? content.length() : contentLength;
+    head += "Content-Length: " + String((unsigned long)length) + "\r\n";
+  }
+  head += keepConnection ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+  head += responseHeaders;
+  head += "\r\n";
+
+  if (!keepConnection) requestKeepAlive = false;
+  chunked = (contentLength == CONTENT_LENGTH_UNKNOWN);
+  responseStarted = true;
+  responseHeaders = String();
+  contentLength = CONTENT_LENGTH_NOT_SET;
+
+  writeClient(head.c_str(), head.length());
+  if (content.length() > 0) {
+    sendContent(content);
+  }
+}
+
+// Chunk-encodes when the length was CONTENT_LENGTH_UNKNOWN; an empty chunk
+// ends the response. Nothing is sent for HEAD.
+void ESP8266WebServer::sendContent(const char* content, size_t length) {
+  if (requestMethod == HTTP_HEAD) {
+    return;
+  }
+  if (!chunked) {
+    writeClient(content, length);
+    return;
+  }
+
+  char size[16];
+  int sizeLength = snprintf(size, sizeof(size), "%zx\r\n", length);
+  std::string chunk(size, sizeLength);
+  chunk.append(content, length);
+  chunk.append("\r\n");
+  writeClient(chunk.data(), chunk.size());
+  if (length == 0) chunked = false;
+}
@@ -0,0 +1,69 @@
+/*
+ * wifi.cpp - WiFi Station and TCP Client on Host Sockets
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ESP8266WiFi.h"
+
+WiFiClass WiFi;
+
+size_t WiFiClient::write(const uint8_t* data, size_t length) {
+  size_t sent = 0;
+  while (fd >= 0 && sent < length) {
+    ssize_t n = ::send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      stop();
+      break;
+    }
+    sent += n;
+  }
+  return sent;
+}
+
+int WiFiClient::available() {
+  int count = 0;
+  if (fd < 0 || ioctl(fd, FIONREAD, &count) != 0) return 0;
+  return count;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+// Waits up to 5 seconds for data, like the device's client timeout
+int WiFiClient::read(uint8_t* buffer, size_t length) {
+  if (fd < 0) return -1;
+  struct pollfd waiting = { fd, POLLIN, 0 };
+  if (poll(&waiting, 1, 5000) <= 0) return -1;
+
+  ssize_t n = recv(fd, buffer, length, 0);
+  return n > 0 ? (int)n : -1;
+}
+
+int WiFiClient::peek() {
+  uint8_t c;
+  if (fd < 0 || recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 1) return -1;
+  return c;
+}
+
+bool WiFiClient::connected() {
+  if (fd < 0) return false;
+  uint8_t c;
+  ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    stop();
+    return false;
+  }
+  return true;
+}
+
+void WiFiClient::stop() {
+  if (fd >= 0) ::close(fd);
+  fd = -1;
+}
@@ -0,0 +1,585 @@
+#!/usr/bin/env python3
+"""
+build_site.py - Pre-render the whole blog for the SD card
+
+Renders every route in routes.txt, each listing page, the archive and the
+404 page exactly as the firmware would, and writes them to the SD card's
+site folder together with a manifest. With SERVE_PREBUILT_SITE set in
+config.h the server then streams these files and does no templating or
+Markdown work at all. Rerun this after editing posts, templates or routes.
+
+Usage:
+    python3 tools/build_site.py [sd_dir] [--gzip] [--posts-per-page N]
+
+sd_dir defaults to sd-card-content. --gzip also writes a .gz sidecar for
+each page that compresses well, sent to clients that accept gzip.
+"""
+
+import argparse
+import gzip
+import os
+import re
+import sys
+
+# Must match the firmware: POSTS_PER_PAGE in config.h and the {{YEAR}}
+# that compileTemplate() in parser.h inlines
+DEFAULT_POSTS_PER_PAGE = 20
+TEMPLATE_YEAR = b'2026'
+
+# Same limits as the firmware's line buffers, so long lines come out the same
+ROUTE_LINE_SIZE = 256
+PREVIEW_LINE_SIZE = 256
+MARKDOWN_LINE_SIZE = 256
+
+SITE_DIR = 'site'
+MANIFEST = 'manifest.txt'
+NOT_FOUND_PAGE = '404.htm'
+
+# Sidecars that don't save at least this fraction aren't worth serving
+MIN_SAVING = 0.10
+
+DEFAULT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'sd-card-content')
+
+TEMPLATE_VARS = {b'TITLE', b'POST_TITLE', b'CONTENT', b'POSTS', b'PAGINATION', b'POST_COUNT', b'POST_LIST'}
+
+
+def fnv1a(data):
+    """hashString() in parser.h"""
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def page_file(url):
+    """Pages are named after the hash of their URL, as prebuiltPagePath() expects."""
+    return '%08x.htm' % fnv1a(url)
+
+
+def read_lines(data, size):
+    """BufferedReader::readLine(): overlong lines are truncated to size - 1 bytes."""
+    lines = data.split(b'\n')
+    if lines and lines[-1] == b'':
+        lines.pop()
+    for line in lines:
+        line = line[:size - 1]
+        if line.endswith(b'\r'):
+            line = line[:-1]
+        yield line
+
+
+def read_file(path):
+    try:
+        with open(path, 'rb') as f:
+            return f.read()
+    except OSError:
+        return None
+
+
+# ============================================================================
+# ROUTES AND TEMPLATES
+# ============================================================================
+
+def load_routes(sd_dir):
+    """(url, file name, title) for each line of routes.txt, parsed like compileRouteFile()."""
+    data = read_file(os.path.join(sd_dir, 'config', 'routes.txt'))
+    if data is None:
+        sys.exit('No config/routes.txt in ' + sd_dir)
+
+    routes = []
+    for line in read_lines(data, ROUTE_LINE_SIZE):
+        line = line.strip(b' \t')
+        if not line or line[:1] in (b'#', b'|'):
+            continue
+        fields = line.split(b'|', 2)
+        if len(fields) == 3:
+            routes.append(tuple(fields))
+    return routes
+
+
+def load_template(sd_dir, name):
+    """Template text with partials and {{YEAR}} inlined, as compileTemplate() does."""
+    def partial(name):
+        return read_file(os.path.join(sd_dir, 'templates', name)) or b''
+
+    html = partial(name)
+    if not html:
+        sys.exit('Template not found: templates/' + name)
+    html = html.replace(b'{{HEADER}}', partial('header.html'))
+    html = html.replace(b'{{FOOTER}}', partial('footer.html'))
+    return html.replace(b'{{YEAR}}', TEMPLATE_YEAR)
+
+
+def render_template(html, values):
+    """renderTemplate(): known placeholders without a value are left as they are."""
+    def fill(match):
+        name = match.group(1)
+        if name in TEMPLATE_VARS and name in values:
+            return values[name]
+        return match.group(0)
+    return re.sub(rb'\{\{(.*?)\}\}', fill, html, flags=re.DOTALL)
+
+
+def post_preview(sd_dir, file_name):
+    """extractPostPreview(): the first paragraph line, cut to about 200 bytes."""
+    data = read_file(os.path.join(sd_dir, 'posts', file_name.decode('utf-8', 'replace')))
+    if data is None:
+        return b'Preview not available.'
+
+    for line in read_lines(data, PREVIEW_LINE_SIZE):
+        line = line.strip(b' \t')
+        if not line or line.startswith(b'#') or line.startswith(b'!['):
+            continue
+        if len(line) > 200:
+            line = line[:200]
+            last_space = line.rfind(b' ')
+            if last_space > 150:
+                line = line[:last_space]
+            line += b'...'
+        return line
+    return b'Preview not available.'
+
+
+# ============================================================================
+# MARKDOWN (a port of markdown.h, so the output is byte for byte the same)
+# ============================================================================
+
+NONE, PARAGRAPH, HEADING, UNORDERED_LIST, ORDERED_LIST, QUOTE, CODE = range(7)
+
+
+def at(text, i):
+    return text[i:i + 1] if 0 <= i < len(text) else b'\0'
+
+
+def is_alpha(c):
+    return c.isalpha() and c.isascii()
+
+
+def is_alnum(c):
+    return c.isalnum() and c.isascii()
+
+
+def escape(text):
+    """writeEscaped()"""
+    return (text.replace(b'&', b'&amp;').replace(b'<', b'&lt;')
+                .replace(b'>', b'&gt;').replace(b'"', b'&quot;')
+                .replace(b"'", b'&#39;'))
+
+
+class Markdown:
+    def __init__(self):
+        self.out = []
+        self.block = NONE
+        self.heading_level = 0
+        self.code_lines = 0
+        self.strong = False
+        self.emphasis = False
+        self.code = False
+
+    def write(self, data):
+        self.out.append(data)
+
+    # Inline elements
+
+    def close_inline(self):
+        if self.code:
+            self.write(b'</code>')
+        if self.emphasis:
+            self.write(b'</em>')
+        if self.strong:
+            self.write(b'</strong>')
+        self.code = self.emphasis = self.strong = False
+
+    def toggle_emphasis(self, attr, tag, text, i, width):
+        before = text[i - 1:i] if i > 0 else b' '
+        after = text[i + width:i + width + 1] if i + width < len(text) else b' '
+        underscore = text[i:i + 1] == b'_'
+        is_open = getattr(self, attr)
+
+        if not is_open and after != b' ' and not (underscore and is_alnum(before)):
+            self.write(b'<')
+        elif is_open and before != b' ' and not (underscore and is_alnum(after)):
+            self.write(b'</')
+        else:
+            return False
+        self.write(tag + b'>')
+        setattr(self, attr, not is_open)
+        return True
+
+    def write_link(self, text, image):
+        close = text.find(b']')
+        if close < 0 or close + 1 >= len(text) or text[close + 1:close + 2] != b'(':
+            return 0
+        url = close + 2
+        end = text.find(b')', url)
+        if end < 0:
+            return 0
+        url_end = url
+        while url_end < end and text[url_end:url_end + 1] != b' ':
+            url_end += 1
+
+        if image:
+            self.write(b'<img src="' + escape(text[url:url_end]) + b'" alt="' +
+                       escape(text[1:close]) + b'" loading="lazy">')
+        else:
+            self.write(b'<a href="' + escape(text[url:url_end]) + b'">')
+            self.write_inline(text[1:close])
+            self.write(b'</a>')
+        return end + 1
+
+    def write_inline(self, text):
+        i = 0
+        while i < len(text):
+            c = text[i:i + 1]
+            nxt = text[i + 1:i + 2]
+
+            if self.code:
+                if c == b'`':
+                    self.write(b'</code>')
+                    self.code = False
+                else:
+                    self.write(escape(c))
+                i += 1
+                continue
+
+            if c == b'\\' and nxt and nxt in b'\\`*_[]()#+-.!>':
+                self.write(escape(nxt))
+                i += 2
+            elif c == b'`':
+                self.write(b'<code>')
+                self.code = True
+                i += 1
+            elif c in (b'*', b'_') and nxt == c and self.toggle_emphasis('strong', b'strong', text, i, 2):
+                i += 2
+            elif c in (b'*', b'_') and self.toggle_emphasis('emphasis', b'em', text, i, 1):
+                i += 1
+            elif c == b'!' and nxt == b'[':
+                used = self.write_link(text[i + 1:], True)
+                if used == 0:
+                    self.write(c)
+                i += used + 1
+            elif c == b'[':
+                used = self.write_link(text[i:], False)
+                if used == 0:
+                    self.write(c)
+                i += used if used > 0 else 1
+            elif c == b'<' and not (is_alpha(nxt) or nxt == b'/' or nxt == b'!'):
+                self.write(b'&lt;')
+                i += 1
+            else:
+                self.write(c)
+                i += 1
+
+    # Block elements
+
+    def close_block(self):
+        self.close_inline()
+        if self.block == PARAGRAPH:
+            self.write(b'</p>\n')
+        elif self.block == UNORDERED_LIST:
+            self.write(b'</li>\n</ul>\n')
+        elif self.block == ORDERED_LIST:
+            self.write(b'</li>\n</ol>\n')
+        elif self.block == QUOTE:
+            self.write(b'</p></blockquote>\n')
+        elif self.block == CODE:
+            self.write(b'</code></pre>\n')
+        elif self.block == HEADING:
+            self.write(b'</h%d>\n' % self.heading_level)
+        self.block = NONE
+
+    def start_list_item(self, kind):
+        if self.block == kind:
+            self.close_inline()
+            self.write(b'</li>\n')
+        else:
+            self.close_block()
+            self.write(b'<ol>\n' if kind == ORDERED_LIST else b'<ul>\n')
+            self.block = kind
+        self.write(b'<li>')
+
+    @staticmethod
+    def is_horizontal_rule(text):
+        marker = text[:1]
+        if marker not in (b'-', b'*', b'_') or not marker:
+            return False
+        if text.replace(marker, b'').replace(b' ', b''):
+            return False
+        return text.count(marker) >= 3
+
+    def render_line(self, line, complete):
+        if self.block == CODE:
+            if line.startswith(b'```'):
+                self.close_block()
+            else:
+                if self.code_lines > 0:
+                    self.write(b'\n')
+                self.code_lines += 1
+                self.write(escape(line))
+            return
+
+        indent = 0
+        while indent < 3 and line[indent:indent + 1] == b' ':
+            indent += 1
+        text = line[indent:]
+
+        if not text.strip(b' \t'):
+            self.close_block()
+            return
+
+        if text.startswith(b'```'):
+            self.close_block()
+            self.write(b'<pre><code')
+            language = text[3:].lstrip(b' ')
+            if language:
+                self.write(b' class="language-' + escape(language) + b'"')
+            self.write(b'>')
+            self.block = CODE
+            self.code_lines = 0
+            return
+
+        if text.startswith(b'#'):
+            level = len(text) - len(text.lstrip(b'#'))
+            if level <= 6 and at(text, level) in (b' ', b'\0'):
+                self.close_block()
+                end = len(text)
+                while complete and end > level and text[end - 1:end] in (b'#', b' '):
+                    end -= 1
+                content = level
+                while content < end and text[content:content + 1] == b' ':
+                    content += 1
+                self.write(b'<h%d>' % level)
+                self.block = HEADING
+                self.heading_level = level
+                self.write_inline(text[content:end])
+                return
+
+        if self.is_horizontal_rule(text):
+            self.close_block()
+            self.write(b'<hr>\n')
+            return
+
+        if text[:1] in (b'-', b'*', b'+') and at(text, 1) == b' ':
+            self.start_list_item(UNORDERED_LIST)
+            self.write_inline(text[2:])
+            return
+
+        digits = len(text) - len(text.lstrip(b'0123456789'))
+        if digits > 0 and at(text, digits) in (b'.', b')') and at(text, digits + 1) == b' ':
+            self.start_list_item(ORDERED_LIST)
+            self.write_inline(text[digits + 2:])
+            return
+
+        if text.startswith(b'>'):
+            content = 2 if at(text, 1) == b' ' else 1
+            if self.block == QUOTE:
+                self.write(b'\n')
+            else:
+                self.close_block()
+                self.write(b'<blockquote><p>')
+                self.block = QUOTE
+            self.write_inline(text[content:])
+            return
+
+        if self.block in (PARAGRAPH, UNORDERED_LIST, ORDERED_LIST, QUOTE):
+            self.write(b'\n')
+        else:
+            self.close_block()
+            self.write(b'<p>')
+            self.block = PARAGRAPH
+        self.write_inline(text)
+
+
+def read_line_part(data, pos, size):
+    """BufferedReader::readLinePart(): (piece, complete, pos) for a piece of up to size - 1 bytes."""
+    newline = data.find(b'\n', pos, pos + size - 1)
+    if newline >= 0:
+        piece, pos, complete = data[pos:newline], newline + 1, True
+    else:
+        piece = data[pos:pos + size - 1]
+        pos += len(piece)
+        complete = pos >= len(data)
+    if complete and piece.endswith(b'\r'):
+        piece = piece[:-1]
+    return piece, complete, pos
+
+
+def piece_end(text):
+    """pieceEnd()"""
+    settled, pending = 0, len(text)
+    for i in range(len(text)):
+        if text[i:i + 1] != b'[':
+            continue
+        close = text.find(b']', i)
+        end = -1
+        if 0 <= close < len(text) - 1 and text[close + 1:close + 2] == b'(':
+            end = text.find(b')', close + 2)
+        if close < 0 or close == len(text) - 1 or (text[close + 1:close + 2] == b'(' and end < 0):
+            pending = i
+            break
+        if end >= 0:
+            settled = max(settled, end + 1)
+
+    space = pending
+    while space > settled and at(text, space) != b' ':
+        space -= 1
+
+    leading = len(text) - len(text.lstrip(b' '))
+    if at(text, space) != b' ' or space <= leading or len(text) - space - 1 > MARKDOWN_LINE_SIZE * 3 // 4:
+        return len(text)
+    return space + 1
+
+
+def render_markdown(data):
+    """renderMarkdown()"""
+    md = Markdown()
+    line_start = True
+    carried = b''
+    pos = 0
+    while pos < len(data):
+        piece, complete, pos = read_line_part(data, pos, MARKDOWN_LINE_SIZE - len(carried))
+        piece = carried + piece
+        end = len(piece) if complete or md.block == CODE else piece_end(piece)
+        piece, carried = piece[:end], piece[end:]
+
+        if line_start:
+            md.render_line(piece, complete and not carried)
+        elif md.block == CODE:
+            md.write(escape(piece))
+        else:
+            md.write_inline(piece)
+        if complete and md.block == HEADING:
+            md.close_block()
+        line_start = complete
+    md.close_block()
+    return b''.join(md.out)
+
+
+# ============================================================================
+# PAGES
+# ============================================================================
+
+def listing_pages(sd_dir, posts, posts_per_page):
+    """servePaginatedPosts() for every page: (url, html)"""
+    template = load_template(sd_dir, 'home.html')
+    total_pages = (len(posts) + posts_per_page - 1) // posts_per_page
+
+    for page in range(total_pages):
+        items = []
+        for url, file_name, title in posts[page * posts_per_page:(page + 1) * posts_per_page]:
+            items.append(b"<div class='post-preview'><h2><a href='" + url + b"'>" + title +
+                         b"</a></h2><p>" + post_preview(sd_dir, file_name) + b"</p></div>")
+
+        pagination = b"<div class='pagination'>"
+        if page > 0:
+            pagination += b"<a href='/page?p=%d'>\xc2\xab Previous</a> " % (page - 1)
+        pagination += b'Page %d of %d' % (page + 1, total_pages)
+        if page < total_pages - 1:
+            pagination += b" <a href='/page?p=%d'>Next \xc2\xbb</a>" % (page + 1)
+        pagination += b'</div>'
+
+        html = render_template(template, {b'TITLE': b'My Blog - Home', b'POSTS': b''.join(items),
+                                          b'PAGINATION': pagination})
+        yield (b'/' if page == 0 else b'/page?p=%d' % page), html
+
+
+def archive_page(sd_dir, posts):
+    """handleArchive()"""
+    items = [b"<li><a href='" + url + b"'>" + title + b"</a></li>" for url, _, title in posts]
+    return render_template(load_template(sd_dir, 'archive.html'), {
+        b'TITLE': b'Archive - All Posts', b'POST_COUNT': b'%d' % len(posts), b'POST_LIST': b''.join(items)})
+
+
+def post_pages(sd_dir, routes, taken):
+    """servePost() for every route with a post file: (url, html). As on the
+    server, the first route for a URL wins and fixed pages come before routes."""
+    template = load_template(sd_dir, 'post.html')
+    for url, file_name, title in routes:
+        if url in taken:
+            continue
+        taken.add(url)
+        data = read_file(os.path.join(sd_dir, 'posts', file_name.decode('utf-8', 'replace')))
+        if data is None:
+            print('missing  posts/%s (%s will be a 404)' % (file_name.decode(), url.decode()))
+            continue
+        yield url, render_template(template, {b'TITLE': title, b'POST_TITLE': title,
+                                              b'CONTENT': render_markdown(data)})
+
+
+# ============================================================================
+# OUTPUT
+# ============================================================================
+
+def write_page(site_dir, name, html, compress):
+    """Writes the page and, if asked and worth it, a .gz sidecar after it."""
+    path = os.path.join(site_dir, name)
+    with open(path, 'wb') as f:
+        f.write(html)
+
+    packed = gzip.compress(html, compresslevel=9, mtime=0) if compress else None
+    if packed is not None and len(packed) <= len(html) * (1 - MIN_SAVING):
+        with open(path + '.gz', 'wb') as f:
+            f.write(packed)
+        return len(packed)
+
+    # A leftover sidecar would be served instead of the new page
+    if os.path.exists(path + '.gz'):
+        os.remove(path + '.gz')
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Pre-render the blog into the SD card site folder')
+    parser.add_argument('sd_dir', nargs='?', default=DEFAULT_DIR)
+    parser.add_argument('--gzip', action='store_true', help='also write .gz sidecars')
+    parser.add_argument('--posts-per-page', type=int, default=DEFAULT_POSTS_PER_PAGE)
+    args = parser.parse_args()
+
+    if not os.path.isdir(args.sd_dir):
+        sys.exit('Not a directory: ' + args.sd_dir)
+    site_dir = os.path.join(args.sd_dir, SITE_DIR)
+    os.makedirs(site_dir, exist_ok=True)
+
+    routes = load_routes(args.sd_dir)
+    posts = [route for route in routes if route[0].startswith(b'/posts/')]
+
+    pages = list(listing_pages(args.sd_dir, posts, args.posts_per_page))
+    pages.append((b'/archive', archive_page(args.sd_dir, posts)))
+    pages.extend(post_pages(args.sd_dir, routes, {url for url, _ in pages}))
+
+    manifest = [b'# Prebuilt site - written by tools/build_site.py, do not edit',
+                b'# Format: /url|file|bytes|gzip bytes (0 = no sidecar)']
+    written = {MANIFEST}
+    total_in = total_out = 0
+    names = {}
+    for url, html in pages:
+        name = page_file(url)
+        if names.setdefault(name, url) != url:
+            sys.exit('%s and %s hash to the same file; rename one' % (names[name].decode(), url.decode()))
+        packed = write_page(site_dir, name, html, args.gzip)
+        manifest.append(b'%s|%s|%d|%d' % (url, name.encode(), len(html), packed))
+        written.update((name, name + '.gz'))
+        total_in += len(html)
+        total_out += packed or len(html)
+        print('%7d %s %s' % (len(html), name, url.decode('utf-8', 'replace')))
+
+    # Served with status 404 for any URL without a page
+    not_found = render_template(load_template(args.sd_dir, '404.html'), {})
+    write_page(site_dir, NOT_FOUND_PAGE, not_found, args.gzip)
+    written.update((NOT_FOUND_PAGE, NOT_FOUND_PAGE + '.gz'))
+
+    with open(os.path.join(site_dir, MANIFEST), 'wb') as f:
+        f.write(b'\n'.join(manifest) + b'\n')
+
+    # Pages of routes that no longer exist
+    for name in sorted(os.listdir(site_dir)):
+        if name not in written:
+            os.remove(os.path.join(site_dir, name))
+            print('removed  ' + name)
+
+    print('%d pages, %d bytes' % (len(pages), total_in) +
+          (' (%d with gzip)' % total_out if args.gzip else ''))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+decode_access_log.py - Print a binary access log as text
+
+Reads an access.bin (or rotated access.N.bin) written with
+LOG_FORMAT_BINARY, together with its .str file, and prints each request in
+the same format as the text access.log.
+
+Usage:
+    python3 tools/decode_access_log.py /path/to/logs/access.bin [--utc-offset SECONDS]
+
+--utc-offset should match gmtOffset_sec in config.h (default 0 = UTC).
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+# Must match AccessLogRecord in firmware/logger.h
+RECORD = struct.Struct('<I4sHHHBB')
+FLAG_UPTIME = 0x01
+METHODS = ['ANY', 'GET', 'HEAD', 'POST', 'PUT', 'PATCH', 'DELETE', 'OPTIONS']
+
+
+def load_strings(path):
+    """Returns the URI and user agent lists of a .str file, indexed by ID."""
+    strings = {b'U': [], b'A': []}
+    try:
+        with open(path, 'rb') as f:
+            data = f.read()
+    except FileNotFoundError:
+        print('warning: %s not found, strings will show as ?' % path, file=sys.stderr)
+        return strings
+
+    pos = 0
+    while pos < len(data):
+        kind = data[pos:pos + 1]
+        end = data.find(b'\0', pos + 1)
+        if end < 0:
+            end = len(data)
+        strings.setdefault(kind, []).append(data[pos + 1:end].decode('utf-8', 'replace'))
+        pos = end + 1
+    return strings
+
+
+def format_timestamp(seconds, flags, utc_offset):
+    if flags & FLAG_UPTIME:
+        return '%dd %dh %dm %ds' % (seconds // 86400, seconds % 86400 // 3600, seconds % 3600 // 60, seconds % 60)
+    return time.strftime('%Y-%m-%d %H:%M:%S', time.gmtime(seconds + utc_offset))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Print a binary access log as text')
+    parser.add_argument('log', help='access.bin or access.N.bin')
+    parser.add_argument('--utc-offset', type=int, default=0, help='seconds east of UTC (gmtOffset_sec)')
+    args = parser.parse_args()
+
+    strings_path = args.log[:-4] + '.str' if args.log.endswith('.bin') else args.log + '.str'
+    strings = load_strings(strings_path)
+    uris, user_agents = strings[b'U'], strings[b'A']
+
+    with open(args.log, 'rb') as f:
+        data = f.read()
+
+    for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        seconds, ip, uri_id, ua_id, status, method, flags = RECORD.unpack_from(data, offset)
+        print('[%s] %d.%d.%d.%d - %s %s - %d - "%s"' % (
+            format_timestamp(seconds, flags, args.utc_offset),
+            ip[0], ip[1], ip[2], ip[3],
+            METHODS[method] if method < len(METHODS) else '?',
+            uris[uri_id] if uri_id < len(uris) else '?',
+            status,
+            user_agents[ua_id] if ua_id < len(user_agents) else '?'))
+
+
+if __name__ == '__main__':
+    main()
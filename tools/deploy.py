@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""
+deploy.py - Push the SD card content to a running server in one request
+
+Packs the SD card folder into a tar archive, gzips it with a history window
+small enough for the firmware to decompress in RAM, and uploads it to
+/admin/deploy, which extracts it onto the card as it arrives. Logs, the
+page cache and the staging folder are never included.
+
+Usage:
+    python3 tools/deploy.py [sd_dir] --host 192.168.1.50 [--password P] [--staged]
+    python3 tools/deploy.py [sd_dir] --output bundle.tar.gz
+
+sd_dir defaults to sd-card-content. --staged extracts into /deploy first and
+moves the files into place only if the whole archive arrived intact.
+--plain sends an uncompressed tar, for boards too short of RAM for gzip.
+"""
+
+import argparse
+import base64
+import io
+import os
+import sys
+import tarfile
+import urllib.error
+import urllib.request
+import uuid
+import zlib
+
+DEFAULT_DIR = 'sd-card-content'
+
+# Must match DEPLOY_GZIP_WINDOW in config.h: 2^13 = 8192 bytes
+WINDOW_BITS = 13
+
+# Written by the server itself; a deploy skips them on the card too
+EXCLUDED_DIRS = {'logs', 'cache', 'deploy'}
+
+
+def build_tar(sd_dir):
+    buffer = io.BytesIO()
+    count = 0
+    # GNU format: long paths get an 'L' entry, which the firmware reads
+    with tarfile.open(fileobj=buffer, mode='w', format=tarfile.GNU_FORMAT) as tar:
+        for root, dirs, files in os.walk(sd_dir):
+            rel_root = os.path.relpath(root, sd_dir)
+            if rel_root == '.':
+                dirs[:] = sorted(d for d in dirs if d not in EXCLUDED_DIRS)
+            else:
+                dirs.sort()
+            for name in sorted(files):
+                if name.endswith('.tmp'):
+                    continue
+                path = os.path.join(root, name)
+                arcname = os.path.normpath(os.path.join(rel_root, name)).replace(os.sep, '/')
+                info = tar.gettarinfo(path, arcname)
+                info.uid = info.gid = 0
+                info.uname = info.gname = ''
+                with open(path, 'rb') as f:
+                    tar.addfile(info, f)
+                count += 1
+    return buffer.getvalue(), count
+
+
+def gzip_small_window(data):
+    # 16 + window bits asks zlib for a gzip header and trailer
+    compressor = zlib.compressobj(9, zlib.DEFLATED, 16 + WINDOW_BITS)
+    return compressor.compress(data) + compressor.flush()
+
+
+def upload(host, password, staged, bundle, filename):
+    boundary = uuid.uuid4().hex
+    body = (('--%s\r\nContent-Disposition: form-data; name="bundle"; filename="%s"\r\n'
+             'Content-Type: application/octet-stream\r\n\r\n') % (boundary, filename)).encode()
+    body += bundle + ('\r\n--%s--\r\n' % boundary).encode()
+
+    url = 'http://%s/admin/deploy%s' % (host, '?staged=1' if staged else '')
+    request = urllib.request.Request(url, data=body, method='POST')
+    request.add_header('Content-Type', 'multipart/form-data; boundary=' + boundary)
+    credentials = base64.b64encode(('admin:' + password).encode()).decode()
+    request.add_header('Authorization', 'Basic ' + credentials)
+    try:
+        with urllib.request.urlopen(request, timeout=600) as response:
+            return True, response.read().decode('utf-8', 'replace')
+    except urllib.error.HTTPError as e:
+        return False, e.read().decode('utf-8', 'replace') or str(e)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Deploy the SD card content to a running server')
+    parser.add_argument('sd_dir', nargs='?', default=DEFAULT_DIR)
+    parser.add_argument('--host', help='server address, e.g. 192.168.1.50 or blog.local:8080')
+    parser.add_argument('--password', default='admin123', help='admin panel password')
+    parser.add_argument('--staged', action='store_true', help='apply only if the whole archive arrives')
+    parser.add_argument('--plain', action='store_true', help='send an uncompressed tar')
+    parser.add_argument('--output', help='write the bundle to this file instead of uploading')
+    args = parser.parse_args()
+
+    if not os.path.isdir(args.sd_dir):
+        sys.exit('Not a directory: ' + args.sd_dir)
+    if not args.host and not args.output:
+        sys.exit('Give --host to upload, or --output to save the bundle')
+
+    tar, count = build_tar(args.sd_dir)
+    bundle = tar if args.plain else gzip_small_window(tar)
+    print('%d files, %d bytes of tar, %d bytes to send' % (count, len(tar), len(bundle)))
+
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(bundle)
+        print('wrote ' + args.output)
+        return
+
+    ok, report = upload(args.host, args.password, args.staged, bundle,
+                        'site.tar' if args.plain else 'site.tar.gz')
+    print(report, end='' if report.endswith('\n') else '\n')
+    if not ok:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""
+gzip_static.py - Precompress static assets for the blog server
+
+Writes a foo.css.gz sidecar next to every compressible file under the SD
+card's static folder. The server sends the sidecar with
+Content-Encoding: gzip to clients that accept it, and ignores any sidecar
+older than its source, so rerun this after editing an asset.
+
+Usage:
+    python3 tools/gzip_static.py [static_dir] [--clean]
+
+static_dir defaults to sd-card-content/static. --clean removes sidecars
+whose source file no longer exists.
+"""
+
+import argparse
+import gzip
+import os
+import sys
+
+# Images and fonts are already compressed; gzip would only add overhead
+COMPRESSIBLE = ('.css', '.js', '.html', '.htm', '.txt', '.svg', '.json', '.xml', '.md')
+
+# Sidecars that don't save at least this fraction aren't worth serving
+MIN_SAVING = 0.10
+
+DEFAULT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'sd-card-content', 'static')
+
+
+def compress(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    # mtime=0 keeps the output identical between runs
+    packed = gzip.compress(data, compresslevel=9, mtime=0)
+    if len(data) == 0 or len(packed) > len(data) * (1 - MIN_SAVING):
+        return len(data), None
+    return len(data), packed
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Write .gz sidecars for static assets')
+    parser.add_argument('static_dir', nargs='?', default=DEFAULT_DIR)
+    parser.add_argument('--clean', action='store_true', help='remove sidecars without a source file')
+    args = parser.parse_args()
+
+    if not os.path.isdir(args.static_dir):
+        sys.exit('Not a directory: ' + args.static_dir)
+
+    total_in = total_out = 0
+    for root, _, files in os.walk(args.static_dir):
+        for name in sorted(files):
+            path = os.path.join(root, name)
+
+            if name.endswith('.gz'):
+                if args.clean and not os.path.exists(path[:-3]):
+                    os.remove(path)
+                    print('removed  ' + os.path.relpath(path, args.static_dir))
+                continue
+            if not name.lower().endswith(COMPRESSIBLE):
+                continue
+
+            size, packed = compress(path)
+            if packed is None:
+                # A leftover sidecar would be served instead of the new file
+                if os.path.exists(path + '.gz'):
+                    os.remove(path + '.gz')
+                print('skipped  %s (%d bytes, does not compress)' % (os.path.relpath(path, args.static_dir), size))
+                continue
+
+            with open(path + '.gz', 'wb') as f:
+                f.write(packed)
+            total_in += size
+            total_out += len(packed)
+            print('%7d -> %6d  %s' % (size, len(packed), os.path.relpath(path, args.static_dir)))
+
+    if total_in:
+        print('total %d -> %d bytes (%.0f%% smaller)' % (total_in, total_out, 100.0 * (1 - total_out / total_in)))
+
+
+if __name__ == '__main__':
+    main()